@@ -0,0 +1,68 @@
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <string>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Crash-safe replacement of a file: write the new contents to a temporary
+// file next to the target, then ReplaceFile(temp, target). After a crash
+// the target holds either the old or the new contents, never a mix.
+
+inline string TempPathFor(const string& target) { return target + ".tmp"; }
+
+// Forces a written file's data to disk.
+inline bool SyncFile(const string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+// Syncs temp, renames it over target and makes the rename itself durable.
+// On failure target is untouched and temp is removed.
+inline bool ReplaceFile(const string& temp, const string& target) {
+    bool ok = SyncFile(temp);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    ok = ok && rename(temp.c_str(), target.c_str()) == 0;
+    if (ok) {
+        filesystem::path dir = filesystem::path(target).parent_path();
+        int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+#endif
+    if (!ok) remove(temp.c_str());
+    return ok;
+}
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef BACKUP_PARSER_H
+#define BACKUP_PARSER_H
+
+#include "structs.h"
+#include "thread_pool.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+// Single-pass parser for the text backup written by FileManager:
+//
+//   ===== PIPES DATA =====
+//   Total pipes: 2
+//   --------------------------------------
+//
+//   ID: 1
+//   KM Mark: km-100
+//   ...
+//   ~~~
+//
+// Lines are string_views into the input and numbers go through
+// from_chars, so nothing is copied except the string fields that end up
+// in the records. Bad values don't throw: the record is dropped and the
+// line and field are reported. So are ids that aren't positive, and
+// (DropDuplicateBackupIds) ids already used earlier in the file.
+
+enum class BackupSection { None, Pipes, Stations };
+
+struct BackupParseError {
+    size_t line = 0;
+    string field;
+    string value;
+    const char* reason = "invalid";
+};
+
+struct BackupParseResult {
+    vector<Pipe> pipes;
+    vector<Compress> stations;
+    vector<size_t> pipeLines;         // line of each record's "ID:"
+    vector<size_t> stationLines;
+    size_t skippedRecords = 0;
+    size_t errorCount = 0;
+    vector<BackupParseError> errors;  // the first MAX_REPORTED_ERRORS of errorCount
+
+    static constexpr size_t MAX_REPORTED_ERRORS = 20;
+
+    void AddError(size_t line, string_view field, string_view value, const char* reason = "invalid") {
+        errorCount++;
+        if (errors.size() < MAX_REPORTED_ERRORS) errors.push_back({line, string(field), string(value), reason});
+    }
+};
+
+class BackupParser {
+private:
+    BackupParseResult& out;
+    BackupSection section;
+    size_t firstLine;
+    size_t lineNumber;
+    size_t inputSize = 0;
+
+    Pipe pipe{};
+    Compress station{};
+    size_t recordLine = 0;
+    bool inRecord = false;
+    bool recordValid = true;
+
+    static bool StartsWith(string_view line, string_view prefix) {
+        return line.size() >= prefix.size() && memcmp(line.data(), prefix.data(), prefix.size()) == 0;
+    }
+
+    static string_view Trim(string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    template<typename N>
+    static bool ParseNumber(string_view s, N& value) {
+        s = Trim(s);
+        const char* end = s.data() + s.size();
+        auto result = from_chars(s.data(), end, value);
+        return result.ec == errc() && result.ptr == end && !s.empty();
+    }
+
+    static bool ParseYesNo(string_view s, bool& value) {
+        s = Trim(s);
+        if (s == "Yes") value = true;
+        else if (s == "No") value = false;
+        else return false;
+        return true;
+    }
+
+    void Error(string_view field, string_view value) {
+        recordValid = false;
+        out.AddError(lineNumber, field, value);
+    }
+
+    template<typename N>
+    void Number(string_view field, string_view value, N& target) {
+        if (!ParseNumber(value, target)) Error(field, value);
+    }
+
+    void YesNo(string_view field, string_view value, bool& target) {
+        if (!ParseYesNo(value, target)) Error(field, value);
+    }
+
+    // Ends the current record, if any, keeping it when it parsed cleanly.
+    void Commit() {
+        if (!inRecord) return;
+        if (!recordValid) {
+            out.skippedRecords++;
+        } else if (section == BackupSection::Pipes) {
+            out.pipes.push_back(move(pipe));
+            out.pipeLines.push_back(recordLine);
+        } else {
+            out.stations.push_back(move(station));
+            out.stationLines.push_back(recordLine);
+        }
+        inRecord = false;
+    }
+
+    void BeginRecord(string_view value) {
+        Commit();
+        inRecord = true;
+        recordValid = true;
+        recordLine = lineNumber;
+        int& id = section == BackupSection::Pipes ? (pipe = Pipe{}).id : (station = Compress{}).id;
+        Number("ID", value, id);
+        if (recordValid && id <= 0) Error("ID", value);
+    }
+
+    void PipeField(string_view line) {
+        if (StartsWith(line, "KM Mark: ")) pipe.km_mark.assign(line.substr(9));
+        else if (StartsWith(line, "Length (km): ")) Number("Length (km)", line.substr(13), pipe.length);
+        else if (StartsWith(line, "Diameter (mm): ")) Number("Diameter (mm)", line.substr(15), pipe.diametr);
+        else if (StartsWith(line, "On repair: ")) YesNo("On repair", line.substr(11), pipe.repair);
+    }
+
+    void StationField(string_view line) {
+        if (StartsWith(line, "Name: ")) station.name.assign(line.substr(6));
+        else if (StartsWith(line, "Workshops: ")) Number("Workshops", line.substr(11), station.workshop_count);
+        else if (StartsWith(line, "Working: ")) Number("Working", line.substr(9), station.workshop_working);
+        else if (StartsWith(line, "Classification: ")) station.classification.assign(line.substr(16));
+        else if (StartsWith(line, "Active: ")) YesNo("Active", line.substr(8), station.working);
+    }
+
+    // A record takes at least 64 bytes of text, which bounds what a
+    // damaged total (or a total seen by one chunk of a split file) can
+    // make us allocate.
+    template<typename T>
+    void Reserve(vector<T>& records, string_view total) {
+        size_t count = 0;
+        if (ParseNumber(total, count)) records.reserve(records.size() + min(count, inputSize / 64));
+    }
+
+    void Line(string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) return;
+
+        if (StartsWith(line, "=====")) {
+            if (line.find("PIPES DATA") != string_view::npos) {
+                Commit();
+                section = BackupSection::Pipes;
+            } else if (line.find("COMPRESSOR STATIONS DATA") != string_view::npos) {
+                Commit();
+                section = BackupSection::Stations;
+            }
+            return;
+        }
+        if (section == BackupSection::None) return;
+        if (line == "~~~") {
+            Commit();
+            return;
+        }
+        if (StartsWith(line, "ID: ")) {
+            BeginRecord(line.substr(4));
+            return;
+        }
+        // Other lines outside a record are ignored; the section totals are
+        // only used to size the output.
+        if (!inRecord) {
+            if (StartsWith(line, "Total pipes: ")) Reserve(out.pipes, line.substr(13));
+            else if (StartsWith(line, "Total stations: ")) Reserve(out.stations, line.substr(16));
+            return;
+        }
+        if (section == BackupSection::Pipes) PipeField(line);
+        else StationField(line);
+    }
+
+public:
+    BackupParser(BackupParseResult& result, BackupSection startSection = BackupSection::None, size_t firstLine = 1)
+        : out(result), section(startSection), firstLine(firstLine), lineNumber(firstLine) {}
+
+    // Parses text, which must end at a line boundary. Records still open
+    // at the end are kept, as in a file without a final "~~~".
+    void Parse(string_view text) {
+        inputSize = text.size();
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            const char* newline = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            const char* lineEnd = newline ? newline : end;
+            Line(string_view(p, size_t(lineEnd - p)));
+            lineNumber++;
+            p = newline ? newline + 1 : end;
+        }
+        Commit();
+    }
+
+    BackupSection Section() const { return section; }
+    size_t LinesParsed() const { return lineNumber - firstLine; }
+};
+
+// Sections in effect from each section header onwards, by offset.
+inline vector<pair<size_t, BackupSection>> FindBackupSections(string_view text) {
+    vector<pair<size_t, BackupSection>> sections;
+    size_t pos = 0;
+    while ((pos = text.find("=====", pos)) != string_view::npos) {
+        if (pos > 0 && text[pos - 1] != '\n') {
+            pos += 5;
+            continue;
+        }
+        size_t end = text.find('\n', pos);
+        string_view line = text.substr(pos, end == string_view::npos ? string_view::npos : end - pos);
+        if (line.find("PIPES DATA") != string_view::npos) sections.push_back({pos, BackupSection::Pipes});
+        else if (line.find("COMPRESSOR STATIONS DATA") != string_view::npos) sections.push_back({pos, BackupSection::Stations});
+        if (end == string_view::npos) break;
+        pos = end + 1;
+    }
+    return sections;
+}
+
+// First offset at or after from that starts a line following a "~~~"
+// line, or text.size() if there is none.
+inline size_t NextBackupRecordBoundary(string_view text, size_t from) {
+    for (size_t pos = text.find("\n~~~", from); pos != string_view::npos; pos = text.find("\n~~~", pos + 1)) {
+        size_t next = pos + 4;
+        if (next < text.size() && text[next] == '\r') next++;
+        if (next < text.size() && text[next] == '\n') return next + 1;
+        if (next == text.size()) return next;
+    }
+    return text.size();
+}
+
+// Parses text on the pool. The input is cut just after "~~~" lines into
+// about four pieces per thread; each piece starts in the section of the
+// last header before it and parses into its own result. The results are
+// returned in file order, with absolute error line numbers, and hold
+// together the same records as a serial BackupParser would produce. They
+// are not merged, so the caller can consume them without another copy.
+inline vector<BackupParseResult> ParseBackupParallel(string_view text, ThreadPool& pool) {
+    static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+    size_t wanted = max<size_t>(1, min(pool.Concurrency() * 4, text.size() / MIN_CHUNK_BYTES));
+
+    vector<size_t> bounds{0};
+    for (size_t i = 1; i < wanted; i++) {
+        size_t cut = NextBackupRecordBoundary(text, max(bounds.back(), text.size() / wanted * i));
+        if (cut >= text.size()) break;
+        if (cut > bounds.back()) bounds.push_back(cut);
+    }
+    bounds.push_back(text.size());
+    size_t chunks = bounds.size() - 1;
+
+    auto sections = FindBackupSections(text);
+    vector<BackupParseResult> parts(chunks);
+    vector<size_t> lines(chunks);
+    pool.ParallelFor(chunks, [&](size_t c) {
+        BackupSection start = BackupSection::None;
+        for (const auto& s : sections) {
+            if (s.first >= bounds[c]) break;
+            start = s.second;
+        }
+        BackupParser parser(parts[c], start);
+        parser.Parse(text.substr(bounds[c], bounds[c + 1] - bounds[c]));
+        lines[c] = parser.LinesParsed();
+    });
+
+    size_t lineBase = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        for (auto& error : parts[c].errors) error.line += lineBase;
+        for (size_t& line : parts[c].pipeLines) line += lineBase;
+        for (size_t& line : parts[c].stationLines) line += lineBase;
+        lineBase += lines[c];
+    }
+    return parts;
+}
+
+template<typename T>
+void DropDuplicateBackupIds(vector<BackupParseResult>& parts, vector<T> BackupParseResult::*records,
+                            vector<size_t> BackupParseResult::*lines) {
+    size_t total = 0;
+    for (const auto& part : parts) total += (part.*records).size();
+    unordered_set<int> seen;
+    seen.reserve(total);
+    for (auto& part : parts) {
+        vector<T>& items = part.*records;
+        vector<size_t>& itemLines = part.*lines;
+        size_t kept = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (!seen.insert(items[i].id).second) {
+                part.AddError(itemLines[i], "ID", to_string(items[i].id), "duplicate");
+                part.skippedRecords++;
+                continue;
+            }
+            if (kept != i) {
+                items[kept] = move(items[i]);
+                itemLines[kept] = itemLines[i];
+            }
+            kept++;
+        }
+        items.resize(kept);
+        itemLines.resize(kept);
+    }
+}
+
+// Keeps the first record with each id, in file order, and reports the
+// later ones as errors at their "ID:" line.
+inline void DropDuplicateBackupIds(vector<BackupParseResult>& parts) {
+    DropDuplicateBackupIds(parts, &BackupParseResult::pipes, &BackupParseResult::pipeLines);
+    DropDuplicateBackupIds(parts, &BackupParseResult::stations, &BackupParseResult::stationLines);
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Cost and payoff of the column mirror (columns.h).
+//
+//   g++ -std=c++17 -O2 -pthread bench/columns_bench.cpp -o columns_bench
+//   ./columns_bench [pipes]
+//
+// Times adds, updates and deletes with the mirror on and off, then the
+// planner's scan fallback (queries no index answers) over the columns
+// and over the rows, and checks that both scans return the same ids.
+
+#include "../pipe_manager.h"
+#include "../query.h"
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+static double Milliseconds(chrono::steady_clock::time_point since) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+static vector<Pipe> MakePipes(size_t n) {
+    mt19937 rng(42);
+    const int diameters[] = {530, 720, 1020, 1220, 1420};
+    vector<Pipe> pipes(n);
+    for (size_t i = 0; i < n; i++) {
+        pipes[i].id = int(i + 1);
+        pipes[i].km_mark = "km-" + to_string(rng() % 100000);
+        pipes[i].length = (rng() % 100000) / 100.0;
+        pipes[i].diametr = diameters[rng() % 5];
+        pipes[i].repair = rng() % 4 == 0;
+    }
+    return pipes;
+}
+
+// Adds every pipe, updates a tenth and deletes a hundredth; returns the
+// milliseconds of each phase.
+static void TimeWrites(const vector<Pipe>& pipes, bool columnar, double times[3]) {
+    Logger logger("columns_bench_log");
+    logger.SetLevel(LogLevel::Off);
+    int nextId = 1;
+    PipeManager manager(nextId, logger);
+    manager.SetColumnar(columnar);
+
+    auto start = chrono::steady_clock::now();
+    for (const Pipe& pipe : pipes) manager.Add(pipe);
+    times[0] = Milliseconds(start);
+
+    start = chrono::steady_clock::now();
+    for (int id = 1; id <= (int)pipes.size(); id += 10) {
+        Pipe pipe = *manager.FindById(id);
+        pipe.repair = !pipe.repair;
+        manager.Update(pipe);
+    }
+    times[1] = Milliseconds(start);
+
+    start = chrono::steady_clock::now();
+    for (int id = 5; id <= (int)pipes.size(); id += 100) manager.Delete(id);
+    times[2] = Milliseconds(start);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    vector<Pipe> pipes = MakePipes(n);
+
+    double off[3], on[3];
+    TimeWrites(pipes, false, off);
+    TimeWrites(pipes, true, on);
+    const char* phases[] = {"add", "update", "delete"};
+    cout << "Writes, " << n << " pipes (ms, mirror off / on):\n";
+    for (int i = 0; i < 3; i++) {
+        cout << "  " << phases[i] << ": " << off[i] << " / " << on[i] << "\n";
+    }
+
+    Logger logger("columns_bench_log");
+    logger.SetLevel(LogLevel::Off);
+    int nextId = 1;
+    PipeManager manager(nextId, logger);
+    manager.AddRange(pipes.begin(), pipes.end());
+    PipeQueryCatalog catalog(manager);
+    QueryPlanner<Pipe> planner(catalog);
+
+    const char* queries[] = {
+        "NOT diameter < 1000",
+        "repair = yes OR length < 100",
+        "diameter != 720 AND NOT (length = 200..800)",
+    };
+    cout << "Scan fallback (ms, rows / columns):\n";
+    for (const char* text : queries) {
+        Query query;
+        string error;
+        QueryParser().Parse(text, query, error);
+        double times[2];
+        vector<int> results[2];
+        for (int columnar = 0; columnar < 2; columnar++) {
+            manager.SetColumnar(columnar == 1);
+            auto plan = planner.Plan(query);
+            auto start = chrono::steady_clock::now();
+            results[columnar] = planner.Execute(plan);
+            times[columnar] = Milliseconds(start);
+        }
+        cout << "  " << text << ": " << times[0] << " / " << times[1] << ", " << results[0].size() << " rows"
+             << (results[0] == results[1] ? "" : "  MISMATCH") << "\n";
+        if (results[0] != results[1]) return 1;
+    }
+    return 0;
+}
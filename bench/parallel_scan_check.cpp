@@ -0,0 +1,158 @@
+// Checks that parallel searches (search_engine.h, thread_pool.h) find the
+// same records in the same order as serial ones.
+//
+//   g++ -std=c++17 -O2 -pthread bench/parallel_scan_check.cpp -o parallel_scan_check
+//   ./parallel_scan_check [rounds] [seed]
+//
+// Each round builds a random set of pipes or stations, with sizes on and
+// around the scan's chunk boundaries, deletes and re-adds some of them so
+// positions are reordered, sometimes pages them out, and then runs random
+// conditions both ways on a pool of random size.
+
+#include "../search_engine.h"
+#include <iostream>
+#include <random>
+#include <functional>
+#include <cstdlib>
+
+using namespace std;
+
+static mt19937 rng;
+
+static int Random(int lo, int hi) { return uniform_int_distribution<int>(lo, hi)(rng); }
+
+static void Fill(Pipe& pipe) {
+    const int diameters[] = {530, 720, 1020, 1220, 1420};
+    pipe.km_mark = "km-" + to_string(Random(0, 999));
+    pipe.length = Random(1, 100000) / 100.0;
+    pipe.diametr = diameters[Random(0, 4)];
+    pipe.repair = Random(0, 3) == 0;
+}
+
+static void Fill(Compress& station) {
+    const char* classes[] = {"A", "B", "C"};
+    station.name = "cs-" + to_string(Random(0, 999));
+    station.workshop_count = Random(0, 12);
+    station.workshop_working = Random(0, station.workshop_count);
+    station.classification = classes[Random(0, 2)];
+    station.working = Random(0, 1) == 1;
+}
+
+// A random AND/OR/NOT tree over a few field tests.
+static function<bool(const Pipe&)> RandomCondition(const Pipe*, int depth) {
+    int kind = Random(0, depth > 0 ? 5 : 2);
+    if (kind == 0) {
+        double lo = Random(0, 900), hi = lo + Random(0, 300);
+        return [lo, hi](const Pipe& p) { return p.length >= lo && p.length <= hi; };
+    }
+    if (kind == 1) {
+        int diameter = Random(0, 1) ? 720 : 1420;
+        return [diameter](const Pipe& p) { return p.diametr == diameter; };
+    }
+    if (kind == 2) {
+        string text = to_string(Random(0, 99));
+        return [text](const Pipe& p) { return p.km_mark.find(text) != string::npos; };
+    }
+    auto a = RandomCondition((const Pipe*)nullptr, depth - 1);
+    if (kind == 5) return [a](const Pipe& p) { return !a(p); };
+    auto b = RandomCondition((const Pipe*)nullptr, depth - 1);
+    if (kind == 3) return [a, b](const Pipe& p) { return a(p) && b(p); };
+    return [a, b](const Pipe& p) { return a(p) || b(p); };
+}
+
+static function<bool(const Compress&)> RandomCondition(const Compress*, int depth) {
+    int kind = Random(0, depth > 0 ? 5 : 2);
+    if (kind == 0) {
+        double percent = Random(0, 100);
+        return [percent](const Compress& s) {
+            return s.workshop_count > 0 && 100.0 * (s.workshop_count - s.workshop_working) / s.workshop_count >= percent;
+        };
+    }
+    if (kind == 1) return [](const Compress& s) { return s.working; };
+    if (kind == 2) {
+        string text = to_string(Random(0, 99));
+        return [text](const Compress& s) { return s.name.find(text) != string::npos; };
+    }
+    auto a = RandomCondition((const Compress*)nullptr, depth - 1);
+    if (kind == 5) return [a](const Compress& s) { return !a(s); };
+    auto b = RandomCondition((const Compress*)nullptr, depth - 1);
+    if (kind == 3) return [a, b](const Compress& s) { return a(s) && b(s); };
+    return [a, b](const Compress& s) { return a(s) || b(s); };
+}
+
+static vector<int> Ids(const ResultSet<Pipe>& results) {
+    vector<int> ids;
+    for (size_t i = 0; i < results.Size(); i++) ids.push_back(results.Get(i)->id);
+    return ids;
+}
+
+static vector<int> Ids(const ResultSet<Compress>& results) {
+    vector<int> ids;
+    for (size_t i = 0; i < results.Size(); i++) ids.push_back(results.Get(i)->id);
+    return ids;
+}
+
+// Runs one round; returns false on a mismatch.
+template<typename T, typename Manager>
+static bool Round(int round, Logger& logger) {
+    // Records per parallel task, as in GenericSearchEngine::ChunkItems().
+    const size_t chunk = max<size_t>(1024, 256 * 1024 / sizeof(T));
+    size_t size;
+    switch (Random(0, 3)) {
+    case 0: size = size_t(Random(0, 3)); break;
+    case 1: size = chunk * size_t(Random(1, 4)) + size_t(Random(-1, 1)); break;
+    default: size = size_t(Random(0, int(6 * chunk))); break;
+    }
+
+    int nextId = 1;
+    Manager manager(nextId, logger);
+    vector<T> records(size);
+    for (size_t i = 0; i < size; i++) {
+        records[i].id = int(i + 1);
+        Fill(records[i]);
+    }
+    manager.AddRange(records.begin(), records.end());
+    nextId = int(size + 1);
+    for (int churn = Random(0, int(size / 4)); churn > 0; churn--) {
+        manager.Delete(Random(1, int(size)));
+        if (Random(0, 1)) {
+            T record{};
+            Fill(record);
+            manager.Add(record);
+        }
+    }
+    bool paged = Random(0, 3) == 0;
+    if (paged) manager.UsePagedStorage({"parallel_scan_check.pages", 4096, 64 * 1024});
+
+    ThreadPool pool(size_t(Random(1, 8)));
+    GenericSearchEngine<T> engine(logger);
+    engine.SetThreadPool(pool);
+    engine.SetParallelThreshold(0);
+    for (int query = 0; query < 8; query++) {
+        auto condition = RandomCondition((const T*)nullptr, Random(0, 3));
+        engine.SetExecutionMode(ExecutionMode::Serial);
+        vector<int> serial = Ids(engine.SearchByCondition(manager, condition, ""));
+        engine.SetExecutionMode(ExecutionMode::Parallel);
+        vector<int> parallel = Ids(engine.SearchByCondition(manager, condition, ""));
+        if (serial != parallel) {
+            cout << "MISMATCH in round " << round << ": " << manager.Size() << " records" << (paged ? " (paged)" : "")
+                 << ", " << pool.Concurrency() << " threads, " << serial.size() << " serial vs " << parallel.size()
+                 << " parallel hits\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    rng.seed(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+    Logger logger("parallel_scan_check_log");
+    logger.SetLevel(LogLevel::Off);
+    for (int round = 0; round < rounds; round++) {
+        bool same = round % 2 ? Round<Compress, CompressManager>(round, logger) : Round<Pipe, PipeManager>(round, logger);
+        if (!same) return 1;
+    }
+    cout << rounds << " rounds, serial and parallel searches agree\n";
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Cost of passing a search condition as std::function against passing it
+// as a template argument (predicates.h).
+//
+//   g++ -std=c++17 -O2 -pthread bench/predicates_bench.cpp -o predicates_bench
+//   ./predicates_bench [pipes]
+//
+// Each filter runs through SearchByCondition on one thread three ways: a
+// predicates.h combinator, the same test as a lambda, and that lambda
+// wrapped in a std::function. All three must find the same pipes.
+
+#include "../search_engine.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+
+using namespace std;
+
+static vector<Pipe> MakePipes(size_t n) {
+    mt19937 rng(42);
+    const int diameters[] = {530, 720, 1020, 1220, 1420};
+    vector<Pipe> pipes(n);
+    for (size_t i = 0; i < n; i++) {
+        pipes[i].id = int(i + 1);
+        pipes[i].km_mark = "km-" + to_string(rng() % 100000);
+        pipes[i].length = (rng() % 100000) / 100.0;
+        pipes[i].diametr = diameters[rng() % 5];
+        pipes[i].repair = rng() % 4 == 0;
+    }
+    return pipes;
+}
+
+// Best of a few runs, in milliseconds.
+template<typename Search>
+static double Time(const Search& search, ResultSet<Pipe>& results) {
+    double best = 1e300;
+    for (int run = 0; run < 5; run++) {
+        auto start = chrono::steady_clock::now();
+        results = search();
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static vector<int> Ids(const ResultSet<Pipe>& results) {
+    vector<int> ids;
+    ids.reserve(results.Size());
+    for (size_t i = 0; i < results.Size(); i++) ids.push_back(results.Get(i)->id);
+    return ids;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+    Logger logger("predicates_bench_log");
+    logger.SetLevel(LogLevel::Off);
+    int nextId = 1;
+    PipeManager manager(nextId, logger);
+    vector<Pipe> pipes = MakePipes(n);
+    manager.AddRange(pipes.begin(), pipes.end());
+    GenericSearchEngine<Pipe> engine(logger);
+    engine.SetExecutionMode(ExecutionMode::Serial);
+
+    auto repair = FieldEquals(&Pipe::repair, true);
+    auto length = FieldBetween(&Pipe::length, 100.0, 400.0);
+    auto diameter = FieldEquals(&Pipe::diametr, 1420);
+    auto one = [](const Pipe& p) { return p.diametr == 1420; };
+    auto two = [](const Pipe& p) { return p.repair && p.length >= 100.0 && p.length <= 400.0; };
+    auto three = [](const Pipe& p) {
+        return (p.repair || p.diametr == 1420) && !(p.length >= 100.0 && p.length <= 400.0);
+    };
+
+    struct Filter {
+        const char* name;
+        function<ResultSet<Pipe>()> combinator, lambda, wrapped;
+    };
+    auto run = [&](auto condition) {
+        return [&engine, &manager, condition] { return engine.SearchByCondition(manager, condition, ""); };
+    };
+    Filter filters[] = {
+        {"1 field", run(diameter), run(one), run(function<bool(const Pipe&)>(one))},
+        {"2 fields", run(AllOf(repair, length)), run(two), run(function<bool(const Pipe&)>(two))},
+        {"and/or/not", run(And(Or(repair, diameter), Not(length))), run(three),
+         run(function<bool(const Pipe&)>(three))},
+    };
+
+    cout << n << " pipes, ms per search (combinator / lambda / std::function):\n" << fixed << setprecision(2);
+    bool agree = true;
+    for (const Filter& filter : filters) {
+        ResultSet<Pipe> results[3] = {ResultSet<Pipe>(manager), ResultSet<Pipe>(manager), ResultSet<Pipe>(manager)};
+        double times[3] = {Time(filter.combinator, results[0]), Time(filter.lambda, results[1]),
+                           Time(filter.wrapped, results[2])};
+        vector<int> ids = Ids(results[0]);
+        bool same = ids == Ids(results[1]) && ids == Ids(results[2]);
+        agree = agree && same;
+        cout << "  " << left << setw(12) << filter.name << right << setw(8) << times[0] << " /" << setw(8) << times[1]
+             << " /" << setw(8) << times[2] << "  (" << ids.size() << " found)" << (same ? "" : "  MISMATCH") << "\n";
+    }
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Throughput of the simd_filters.h kernels at each SIMD level.
+//
+//   g++ -std=c++17 -O2 bench/simd_filters_bench.cpp -o simd_filters_bench
+//   ./simd_filters_bench [rows]
+//
+// Each filter runs on the same random columns with ActiveSimdLevel()
+// lowered to Scalar, SSE4.2 and AVX2 (as far as the CPU allows); the
+// selections must agree. These kernels back the planner's column scans
+// (query.h).
+
+#include "../simd_filters.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+
+using namespace std;
+
+// Best of a few runs, in milliseconds.
+static double Time(const function<SelectionBitmap()>& filter, SelectionBitmap& result) {
+    double best = 1e300;
+    for (int run = 0; run < 5; run++) {
+        auto start = chrono::steady_clock::now();
+        result = filter();
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000000;
+    mt19937 rng(7);
+    vector<int> diameters(n), total(n), part(n);
+    vector<double> lengths(n);
+    vector<uint8_t> flags(n);
+    for (size_t i = 0; i < n; i++) {
+        diameters[i] = 500 + int(rng() % 1000);
+        lengths[i] = (rng() % 100000) / 100.0;
+        flags[i] = rng() % 2;
+        total[i] = int(rng() % 12);
+        part[i] = total[i] ? int(rng() % (total[i] + 1)) : 0;
+    }
+
+    struct Filter {
+        const char* name;
+        function<SelectionBitmap()> run;
+    };
+    Filter filters[] = {
+        {"int range", [&] { return FilterIntRange(diameters, 700, 1100); }},
+        {"double range", [&] { return FilterDoubleRange(lengths, 100.0, 400.0); }},
+        {"byte equals", [&] { return FilterByteEquals(flags, 1); }},
+        {"percent range", [&] { return FilterPercentRange(part, total, 25.0, 75.0); }},
+    };
+
+    SimdLevel detected = ActiveSimdLevel();
+    vector<pair<SimdLevel, const char*>> levels = {{SimdLevel::Scalar, "scalar"}};
+    if (detected != SimdLevel::Scalar) levels.push_back({SimdLevel::SSE42, "sse4.2"});
+    if (detected == SimdLevel::AVX2) levels.push_back({SimdLevel::AVX2, "avx2"});
+
+    cout << n << " rows, ms per filter:\n" << fixed << setprecision(2);
+    bool agree = true;
+    for (const Filter& filter : filters) {
+        cout << "  " << left << setw(14) << filter.name << right;
+        SelectionBitmap reference, result;
+        for (size_t l = 0; l < levels.size(); l++) {
+            ActiveSimdLevel() = levels[l].first;
+            double ms = Time(filter.run, l == 0 ? reference : result);
+            if (l > 0 && result.words != reference.words) agree = false;
+            cout << "  " << levels[l].second << " " << setw(7) << ms;
+        }
+        cout << "  (" << reference.Count() << " selected)\n";
+    }
+    ActiveSimdLevel() = detected;
+    if (!agree) {
+        cout << "MISMATCH between SIMD levels\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+#ifndef BITMAP_INDEX_H
+#define BITMAP_INDEX_H
+
+#include "generic_manager.h"
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Compressed set of record ids, roaring style: ids are split by their
+// high 16 bits into containers that hold the low 16 bits either as a
+// sorted array (sparse) or as a 65536-bit bitmap (dense).
+class RoaringBitmap {
+private:
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t BITMAP_WORDS = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        vector<uint16_t> array;
+        vector<uint64_t> bits;
+
+        bool IsBitmap() const { return !bits.empty(); }
+
+        bool Contains(uint16_t low) const {
+            if (IsBitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return binary_search(array.begin(), array.end(), low);
+        }
+
+        bool Add(uint16_t low) {
+            if (IsBitmap()) {
+                uint64_t bit = uint64_t(1) << (low & 63);
+                if (bits[low >> 6] & bit) return false;
+                bits[low >> 6] |= bit;
+            } else {
+                auto it = lower_bound(array.begin(), array.end(), low);
+                if (it != array.end() && *it == low) return false;
+                array.insert(it, low);
+                if (array.size() > ARRAY_LIMIT) ToBitmap();
+            }
+            cardinality++;
+            return true;
+        }
+
+        bool Remove(uint16_t low) {
+            if (IsBitmap()) {
+                uint64_t bit = uint64_t(1) << (low & 63);
+                if (!(bits[low >> 6] & bit)) return false;
+                bits[low >> 6] &= ~bit;
+                cardinality--;
+                if (cardinality <= ARRAY_LIMIT / 2) ToArray();
+            } else {
+                auto it = lower_bound(array.begin(), array.end(), low);
+                if (it == array.end() || *it != low) return false;
+                array.erase(it);
+                cardinality--;
+            }
+            return true;
+        }
+
+        void ToBitmap() {
+            bits.assign(BITMAP_WORDS, 0);
+            for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+            array.clear();
+            array.shrink_to_fit();
+        }
+
+        void ToArray() {
+            array.clear();
+            array.reserve(cardinality);
+            ForEach([this](uint16_t low) { array.push_back(low); });
+            bits.clear();
+            bits.shrink_to_fit();
+        }
+
+        template<typename F>
+        void ForEach(F f) const {
+            if (!IsBitmap()) {
+                for (uint16_t low : array) f(low);
+                return;
+            }
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                uint64_t word = bits[w];
+                while (word) {
+                    f((uint16_t)(w * 64 + __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        }
+    };
+
+    vector<Container> containers;   // sorted by key
+
+    size_t Find(uint16_t key) const {
+        return lower_bound(containers.begin(), containers.end(), key,
+            [](const Container& c, uint16_t k) { return c.key < k; }) - containers.begin();
+    }
+
+    static Container AndContainers(const Container& a, const Container& b) {
+        Container out;
+        out.key = a.key;
+        if (a.IsBitmap() && b.IsBitmap()) {
+            out.bits.resize(BITMAP_WORDS);
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                out.bits[w] = a.bits[w] & b.bits[w];
+                out.cardinality += __builtin_popcountll(out.bits[w]);
+            }
+            if (out.cardinality <= ARRAY_LIMIT) out.ToArray();
+        } else if (!a.IsBitmap() && !b.IsBitmap()) {
+            set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+            out.cardinality = (uint32_t)out.array.size();
+        } else {
+            const Container& sparse = a.IsBitmap() ? b : a;
+            const Container& dense = a.IsBitmap() ? a : b;
+            for (uint16_t low : sparse.array) {
+                if (dense.Contains(low)) out.array.push_back(low);
+            }
+            out.cardinality = (uint32_t)out.array.size();
+        }
+        return out;
+    }
+
+    static Container OrContainers(const Container& a, const Container& b) {
+        Container out;
+        out.key = a.key;
+        if (!a.IsBitmap() && !b.IsBitmap() && a.cardinality + b.cardinality <= ARRAY_LIMIT) {
+            set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+            out.cardinality = (uint32_t)out.array.size();
+            return out;
+        }
+        out.bits.assign(BITMAP_WORDS, 0);
+        for (const Container* c : {&a, &b}) {
+            if (c->IsBitmap()) {
+                for (size_t w = 0; w < BITMAP_WORDS; w++) out.bits[w] |= c->bits[w];
+            } else {
+                for (uint16_t low : c->array) out.bits[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+        for (uint64_t word : out.bits) out.cardinality += __builtin_popcountll(word);
+        if (out.cardinality <= ARRAY_LIMIT) out.ToArray();
+        return out;
+    }
+
+public:
+    void Add(uint32_t value) {
+        uint16_t key = value >> 16;
+        size_t i = Find(key);
+        if (i == containers.size() || containers[i].key != key) {
+            Container c;
+            c.key = key;
+            containers.insert(containers.begin() + i, c);
+        }
+        containers[i].Add(value & 0xFFFF);
+    }
+
+    void Remove(uint32_t value) {
+        uint16_t key = value >> 16;
+        size_t i = Find(key);
+        if (i == containers.size() || containers[i].key != key) return;
+        containers[i].Remove(value & 0xFFFF);
+        if (containers[i].cardinality == 0) containers.erase(containers.begin() + i);
+    }
+
+    bool Contains(uint32_t value) const {
+        uint16_t key = value >> 16;
+        size_t i = Find(key);
+        return i < containers.size() && containers[i].key == key && containers[i].Contains(value & 0xFFFF);
+    }
+
+    size_t Cardinality() const {
+        size_t total = 0;
+        for (const auto& c : containers) total += c.cardinality;
+        return total;
+    }
+
+    bool Empty() const { return containers.empty(); }
+
+    static RoaringBitmap And(const RoaringBitmap& a, const RoaringBitmap& b) {
+        RoaringBitmap out;
+        size_t i = 0, j = 0;
+        while (i < a.containers.size() && j < b.containers.size()) {
+            if (a.containers[i].key < b.containers[j].key) i++;
+            else if (b.containers[j].key < a.containers[i].key) j++;
+            else {
+                Container c = AndContainers(a.containers[i++], b.containers[j++]);
+                if (c.cardinality > 0) out.containers.push_back(move(c));
+            }
+        }
+        return out;
+    }
+
+    static RoaringBitmap Or(const RoaringBitmap& a, const RoaringBitmap& b) {
+        RoaringBitmap out;
+        size_t i = 0, j = 0;
+        while (i < a.containers.size() || j < b.containers.size()) {
+            if (j == b.containers.size() || (i < a.containers.size() && a.containers[i].key < b.containers[j].key)) {
+                out.containers.push_back(a.containers[i++]);
+            } else if (i == a.containers.size() || b.containers[j].key < a.containers[i].key) {
+                out.containers.push_back(b.containers[j++]);
+            } else {
+                out.containers.push_back(OrContainers(a.containers[i++], b.containers[j++]));
+            }
+        }
+        return out;
+    }
+
+    // Ids in ascending order.
+    vector<int> ToIds() const {
+        vector<int> ids;
+        ids.reserve(Cardinality());
+        for (const auto& c : containers) {
+            uint32_t high = (uint32_t)c.key << 16;
+            c.ForEach([&ids, high](uint16_t low) { ids.push_back((int)(high | low)); });
+        }
+        return ids;
+    }
+};
+
+// One RoaringBitmap of ids per distinct value of a low-cardinality field.
+template<typename T, typename Key>
+class BitmapIndex : public ManagerListener<T> {
+public:
+    using KeyFn = Key (*)(const T& item);
+
+private:
+    KeyFn keyOf;
+    map<Key, RoaringBitmap> bitmaps;
+
+    void Remove(const Key& key, int id) {
+        auto it = bitmaps.find(key);
+        if (it == bitmaps.end()) return;
+        it->second.Remove((uint32_t)id);
+        if (it->second.Empty()) bitmaps.erase(it);
+    }
+
+public:
+    explicit BitmapIndex(KeyFn fn) : keyOf(fn) {}
+
+    void OnInserted(const T& item, size_t) override { bitmaps[keyOf(item)].Add((uint32_t)item.id); }
+    void OnErased(const T& item, size_t, size_t) override { Remove(keyOf(item), item.id); }
+
+    void OnUpdated(const T& before, const T& after, size_t) override {
+        Key oldKey = keyOf(before);
+        Key newKey = keyOf(after);
+        if (oldKey == newKey) return;
+        Remove(oldKey, before.id);
+        bitmaps[newKey].Add((uint32_t)after.id);
+    }
+
+    void OnCleared() override { bitmaps.clear(); }
+
+    const RoaringBitmap& Get(const Key& key) const {
+        static const RoaringBitmap empty;
+        auto it = bitmaps.find(key);
+        return it == bitmaps.end() ? empty : it->second;
+    }
+
+    // Union of the bitmaps of every distinct value accepted by pred.
+    template<typename Pred>
+    RoaringBitmap Union(Pred pred) const {
+        RoaringBitmap result;
+        for (const auto& entry : bitmaps) {
+            if (pred(entry.first)) result = RoaringBitmap::Or(result, entry.second);
+        }
+        return result;
+    }
+
+    size_t DistinctValues() const { return bitmaps.size(); }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+using namespace std;
+
+// Fixed-capacity lock-free queue for many producers and one consumer.
+// Each cell carries a sequence number that says whose turn it is, so a
+// producer claims a cell with one CAS on the tail and publishes it with a
+// store; the consumer never contends with producers on the same counter.
+template<typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Cell> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) atomic<size_t> head{0};
+
+    static size_t RoundUp(size_t n) {
+        size_t p = 2;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity) : cells(RoundUp(capacity)), mask(cells.size() - 1) {
+        for (size_t i = 0; i < cells.size(); i++) cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t Capacity() const { return cells.size(); }
+
+    // Returns false when the queue is full; value is left untouched then.
+    bool TryPush(T& value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            if (seq == pos) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = move(value);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only.
+    bool TryPop(T& value) {
+        size_t pos = head.load(memory_order_relaxed);
+        Cell& cell = cells[pos & mask];
+        if (cell.sequence.load(memory_order_acquire) != pos + 1) return false;
+        value = move(cell.value);
+        cell.sequence.store(pos + cells.size(), memory_order_release);
+        head.store(pos + 1, memory_order_relaxed);
+        return true;
+    }
+
+    bool Empty() const {
+        size_t pos = head.load(memory_order_relaxed);
+        return cells[pos & mask].sequence.load(memory_order_acquire) != pos + 1;
+    }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include "structs.h"
+#include "generic_manager.h"
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Structure-of-arrays copy of the numeric fields, kept in the same
+// storage positions as the manager's records. String fields stay in the
+// row records and are reached through the position.
+template<typename T>
+class ColumnStore : public ManagerListener<T> {
+public:
+    vector<int> id;
+
+    size_t Size() const { return id.size(); }
+
+    void OnInserted(const T& item, size_t) override {
+        id.push_back(item.id);
+        Append(item);
+    }
+
+    void OnInsertedRange(const T* values, size_t count, size_t) override {
+        ReserveColumns(id.size() + count);
+        id.reserve(id.size() + count);
+        for (size_t i = 0; i < count; i++) {
+            id.push_back(values[i].id);
+            Append(values[i]);
+        }
+    }
+
+    void OnErased(const T&, size_t position, size_t lastPosition) override {
+        SwapRemove(id, position, lastPosition);
+        MoveLast(position, lastPosition);
+    }
+
+    void OnUpdated(const T&, const T& after, size_t position) override {
+        id[position] = after.id;
+        Assign(after, position);
+    }
+
+    void OnCleared() override {
+        id.clear();
+        ClearColumns();
+    }
+
+protected:
+    virtual void Append(const T& item) = 0;
+    virtual void Assign(const T& item, size_t position) = 0;
+    virtual void MoveLast(size_t position, size_t lastPosition) = 0;
+    virtual void ClearColumns() = 0;
+    virtual void ReserveColumns(size_t n) = 0;
+
+    template<typename V>
+    static void SwapRemove(vector<V>& column, size_t position, size_t lastPosition) {
+        column[position] = column[lastPosition];
+        column.pop_back();
+    }
+};
+
+class PipeColumns : public ColumnStore<Pipe> {
+public:
+    vector<double> length;
+    vector<int> diametr;
+    vector<uint8_t> repair;
+
+protected:
+    void Append(const Pipe& pipe) override {
+        length.push_back(pipe.length);
+        diametr.push_back(pipe.diametr);
+        repair.push_back(pipe.repair);
+    }
+
+    void Assign(const Pipe& pipe, size_t position) override {
+        length[position] = pipe.length;
+        diametr[position] = pipe.diametr;
+        repair[position] = pipe.repair;
+    }
+
+    void MoveLast(size_t position, size_t lastPosition) override {
+        SwapRemove(length, position, lastPosition);
+        SwapRemove(diametr, position, lastPosition);
+        SwapRemove(repair, position, lastPosition);
+    }
+
+    void ClearColumns() override {
+        length.clear();
+        diametr.clear();
+        repair.clear();
+    }
+
+    void ReserveColumns(size_t n) override {
+        length.reserve(n);
+        diametr.reserve(n);
+        repair.reserve(n);
+    }
+};
+
+class CompressColumns : public ColumnStore<Compress> {
+public:
+    vector<int> workshop_count;
+    vector<int> workshop_working;
+    vector<uint8_t> working;
+
+protected:
+    void Append(const Compress& station) override {
+        workshop_count.push_back(station.workshop_count);
+        workshop_working.push_back(station.workshop_working);
+        working.push_back(station.working);
+    }
+
+    void Assign(const Compress& station, size_t position) override {
+        workshop_count[position] = station.workshop_count;
+        workshop_working[position] = station.workshop_working;
+        working[position] = station.working;
+    }
+
+    void MoveLast(size_t position, size_t lastPosition) override {
+        SwapRemove(workshop_count, position, lastPosition);
+        SwapRemove(workshop_working, position, lastPosition);
+        SwapRemove(working, position, lastPosition);
+    }
+
+    void ClearColumns() override {
+        workshop_count.clear();
+        workshop_working.clear();
+        working.clear();
+    }
+
+    void ReserveColumns(size_t n) override {
+        workshop_count.reserve(n);
+        workshop_working.reserve(n);
+        working.reserve(n);
+    }
+};
+
+#endif
@@ -3,31 +3,77 @@
 
 #include "structs.h"
 #include "generic_manager.h"
-#include <sstream>
+#include "columns.h"
+#include "sorted_index.h"
+#include "bitmap_index.h"
+#include "trigram_index.h"
 
 using namespace std;
 
 class CompressManager : public GenericManager<Compress> {
 public:
-    CompressManager(int& id, Logger& log) : GenericManager<Compress>(id, log) {}
+    CompressManager(int& id, Logger& log)
+        : GenericManager<Compress>(id, log),
+          workingIndex([](const Compress& c, int& key) { key = c.workshop_working; return true; }),
+          utilizationIndex(&UtilizationKey),
+          statusBitmaps([](const Compress& c) { return c.working; }),
+          classificationBitmaps([](const Compress& c) { return c.classification; }),
+          nameTrigrams([](const Compress& c) -> const string& { return c.name; }) {
+        Subscribe(&workingIndex);
+        Subscribe(&utilizationIndex);
+        Subscribe(&statusBitmaps);
+        Subscribe(&classificationBitmaps);
+        Subscribe(&nameTrigrams);
+        SetColumnar(true);
+    }
+
+    // Percentage of workshops in work; stations without workshops have none.
+    static bool UtilizationKey(const Compress& station, double& key) {
+        if (station.workshop_count <= 0) return false;
+        key = (double)station.workshop_working / station.workshop_count * 100;
+        return true;
+    }
+
+    // Columnar mode keeps a CompressColumns mirror that numeric searches scan
+    // instead of the row records.
+    void SetColumnar(bool enabled) {
+        if (enabled == columnar) return;
+        columnar = enabled;
+        if (enabled) {
+            Subscribe(&columns);
+        } else {
+            Unsubscribe(&columns);
+            columns.OnCleared();
+        }
+    }
+
+    const CompressColumns* Columns() const { return columnar ? &columns : nullptr; }
+    const SortedIndex<Compress, int>& WorkingIndex() const { return workingIndex; }
+    const SortedIndex<Compress, double>& UtilizationIndex() const { return utilizationIndex; }
+    const BitmapIndex<Compress, bool>& StatusBitmaps() const { return statusBitmaps; }
+    const BitmapIndex<Compress, string>& ClassificationBitmaps() const { return classificationBitmaps; }
+    const TrigramIndex<Compress>& NameTrigrams() const { return nameTrigrams; }
 
 private:
+    CompressColumns columns;
+    bool columnar = false;
+    SortedIndex<Compress, int> workingIndex;
+    SortedIndex<Compress, double> utilizationIndex;
+    BitmapIndex<Compress, bool> statusBitmaps;
+    BitmapIndex<Compress, string> classificationBitmaps;
+    TrigramIndex<Compress> nameTrigrams;
+
     void OnAdd(const Compress& station) override {
-        stringstream ss;
-        ss << "ADDED CS - ID: " << station.id << ", Name: " << station.name 
-           << ", Workshops: " << station.workshop_count 
-           << ", Working: " << station.workshop_working
-           << ", Class: " << station.classification 
-           << ", Active: " << (station.working ? "Yes" : "No");
-        logger.Log(ss.str());
+        logger.Log(LogEvent::AddedCs, station.id, station.name, station.workshop_count,
+                   station.workshop_working, station.classification, station.working);
+    }
+
+    void OnAddRange(size_t count) override {
+        logger.Log(LogEvent::AddedCsRange, count, Size());
     }
 
     void OnDelete(const Compress& station) override {
-        stringstream ss;
-        ss << "DELETED CS - ID: " << station.id << ", Name: " << station.name 
-           << ", Workshops: " << station.workshop_count 
-           << ", Working: " << station.workshop_working;
-        logger.Log(ss.str());
+        logger.Log(LogEvent::DeletedCs, station.id, station.name, station.workshop_count, station.workshop_working);
     }
 };
 
@@ -0,0 +1,209 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+// Streaming RFC 4180 CSV. Fields are separated by commas and records by
+// CRLF or LF; a field in double quotes may hold commas, line breaks and
+// "" for a quote. Both sides work through a fixed-size buffer, so memory
+// doesn't grow with the file.
+
+// One record. fields has at least count entries; the strings past count
+// are kept only for their capacity.
+struct CsvRow {
+    vector<string> fields;
+    size_t count = 0;
+    size_t line = 0;        // line the record starts on, from 1
+
+    const string& operator[](size_t i) const { return fields[i]; }
+    size_t Size() const { return count; }
+};
+
+class CsvReader {
+private:
+    static constexpr size_t BUFFER_BYTES = 1 << 20;
+    static constexpr size_t MAX_RECORD_BYTES = 1 << 20;
+
+    ifstream in;
+    vector<char> buffer;
+    size_t pos = 0;
+    size_t end = 0;
+    size_t line = 1;
+    string error;
+
+    // Next byte, or -1 at the end of the input.
+    int Get() {
+        if (pos == end) {
+            if (!in) return -1;
+            in.read(buffer.data(), streamsize(buffer.size()));
+            end = size_t(in.gcount());
+            pos = 0;
+            if (end == 0) return -1;
+        }
+        return (unsigned char)buffer[pos++];
+    }
+
+    int Peek() {
+        int c = Get();
+        if (c >= 0) pos--;
+        return c;
+    }
+
+    string& NewField(CsvRow& row) {
+        if (row.count == row.fields.size()) row.fields.emplace_back();
+        string& field = row.fields[row.count++];
+        field.clear();
+        return field;
+    }
+
+public:
+    CsvReader() : buffer(BUFFER_BYTES) {}
+
+    bool Open(const string& filename) {
+        in.open(filename, ios::binary);
+        if (!in.is_open()) return false;
+        // A UTF-8 byte order mark isn't part of the first field.
+        if (Peek() == 0xEF && end - pos >= 3 && memcmp(buffer.data() + pos, "\xEF\xBB\xBF", 3) == 0) pos += 3;
+        return true;
+    }
+
+    // Reads the next record into row, skipping blank lines. Returns false
+    // at the end of the input or on an error (see Error()).
+    bool Next(CsvRow& row) {
+        row.count = 0;
+        int c = Get();
+        while (c == '\r' || c == '\n') {
+            if (c == '\n') line++;
+            c = Get();
+        }
+        if (c < 0) return false;
+
+        row.line = line;
+        size_t bytes = 0;
+        string* field = &NewField(row);
+        bool quoted = false;
+        bool atFieldStart = true;
+        for (;; c = Get()) {
+            if (++bytes > MAX_RECORD_BYTES) {
+                error = "record at line " + to_string(row.line) + " is longer than " + to_string(MAX_RECORD_BYTES) +
+                        " bytes (unbalanced quote?)";
+                return false;
+            }
+            if (quoted) {
+                if (c < 0) {
+                    error = "unterminated quoted field at line " + to_string(row.line);
+                    return false;
+                }
+                if (c == '"') {
+                    if (Peek() == '"') {
+                        Get();
+                        *field += '"';
+                    } else {
+                        quoted = false;
+                    }
+                    continue;
+                }
+                if (c == '\n') line++;
+                *field += char(c);
+                continue;
+            }
+            if (c < 0 || c == '\n' || c == '\r') {
+                if (c == '\r' && Peek() == '\n') Get();
+                if (c >= 0) line++;
+                return true;
+            }
+            if (c == ',') {
+                field = &NewField(row);
+                atFieldStart = true;
+                continue;
+            }
+            if (c == '"' && atFieldStart) {
+                quoted = true;
+                atFieldStart = false;
+                continue;
+            }
+            // A stray quote inside an unquoted field is kept as is.
+            atFieldStart = false;
+            *field += char(c);
+        }
+    }
+
+    const string& Error() const { return error; }
+};
+
+class CsvWriter {
+private:
+    static constexpr size_t BUFFER_BYTES = 1 << 20;
+
+    ofstream out;
+    string buffer;
+    bool rowStarted = false;
+
+    void Separator() {
+        if (rowStarted) buffer += ',';
+        rowStarted = true;
+    }
+
+    void FlushIfFull() {
+        if (buffer.size() < BUFFER_BYTES) return;
+        out.write(buffer.data(), streamsize(buffer.size()));
+        buffer.clear();
+    }
+
+public:
+    bool Open(const string& filename) {
+        out.open(filename, ios::binary | ios::trunc);
+        buffer.reserve(BUFFER_BYTES + 4096);
+        return out.is_open();
+    }
+
+    // Quotes the field only when it has to: separators, quotes, line
+    // breaks or edge spaces that a reader could trim.
+    void Field(string_view value) {
+        Separator();
+        bool quote = value.find_first_of(",\"\r\n") != string_view::npos ||
+                     (!value.empty() && (value.front() == ' ' || value.back() == ' '));
+        if (!quote) {
+            buffer += value;
+            return;
+        }
+        buffer += '"';
+        for (char c : value) {
+            if (c == '"') buffer += '"';
+            buffer += c;
+        }
+        buffer += '"';
+    }
+
+    // Integers as is, doubles in the shortest form that reads back exactly.
+    template<typename N>
+    void Number(N value) {
+        Separator();
+        char text[32];
+        auto result = to_chars(text, text + sizeof(text), value);
+        buffer.append(text, result.ptr);
+    }
+
+    void EndRow() {
+        buffer += "\r\n";
+        rowStarted = false;
+        FlushIfFull();
+    }
+
+    // Writes what's buffered; false if any write failed.
+    bool Close() {
+        out.write(buffer.data(), streamsize(buffer.size()));
+        buffer.clear();
+        out.close();
+        return !out.fail();
+    }
+};
+
+#endif
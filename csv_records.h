@@ -0,0 +1,395 @@
+#ifndef CSV_RECORDS_H
+#define CSV_RECORDS_H
+
+#include "structs.h"
+#include "csv.h"
+#include "atomic_file.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <charconv>
+#include <cmath>
+#include <climits>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+
+using namespace std;
+
+// Pipes and stations as CSV. Export writes a header row and one row per
+// record:
+//
+//   id,km_mark,length,diameter,repair
+//   id,name,workshops,working_workshops,classification,active
+//
+// Import maps the header to these columns by name, ignoring case, spaces,
+// '_' and '-' and accepting a few aliases (diametr, class, ...), so
+// columns may come in any order and unknown ones are skipped. Rows are
+// validated like the add screens validate input; a bad row is reported
+// by line and column and skipped. Rows without an id get a new one; a
+// row whose id is already taken, by a record or an earlier row, is an
+// error unless the import is told to replace.
+
+struct CsvColumn {
+    const char* name;
+    const char* aliases;    // '|'-separated, already normalized
+    bool required;
+};
+
+struct CsvRowError {
+    size_t line = 0;
+    string column;
+    string value;
+    string reason;
+};
+
+struct CsvImportResult {
+    bool opened = false;
+    string fatal;                   // why the import stopped early, if it did
+    vector<string> ignoredColumns;
+    size_t rows = 0;
+    size_t imported = 0;            // new records
+    size_t replaced = 0;            // rows that replaced a record with their id
+    size_t skipped = 0;
+    size_t errorCount = 0;
+    vector<CsvRowError> errors;     // the first MAX_REPORTED_ERRORS of errorCount
+
+    static constexpr size_t MAX_REPORTED_ERRORS = 20;
+};
+
+namespace csv {
+
+inline string Normalize(string_view name) {
+    string key;
+    for (char c : name) {
+        if (c == ' ' || c == '_' || c == '-' || c == '\t') continue;
+        key += char(tolower((unsigned char)c));
+    }
+    return key;
+}
+
+inline bool Matches(const CsvColumn& column, const string& key) {
+    if (key == Normalize(column.name)) return true;
+    string_view aliases = column.aliases;
+    while (!aliases.empty()) {
+        size_t bar = aliases.find('|');
+        if (aliases.substr(0, bar) == key) return true;
+        if (bar == string_view::npos) break;
+        aliases.remove_prefix(bar + 1);
+    }
+    return false;
+}
+
+// Fills fieldOf[column] with the header field holding it, or -1.
+inline bool MapHeader(const CsvRow& header, const CsvColumn* columns, size_t columnCount,
+                      vector<int>& fieldOf, CsvImportResult& result) {
+    fieldOf.assign(columnCount, -1);
+    for (size_t f = 0; f < header.Size(); f++) {
+        string key = Normalize(header[f]);
+        size_t c = 0;
+        while (c < columnCount && !Matches(columns[c], key)) c++;
+        if (c == columnCount) {
+            result.ignoredColumns.push_back(header[f]);
+        } else if (fieldOf[c] >= 0) {
+            result.fatal = "column '" + string(columns[c].name) + "' appears twice in the header";
+            return false;
+        } else {
+            fieldOf[c] = int(f);
+        }
+    }
+    for (size_t c = 0; c < columnCount; c++) {
+        if (columns[c].required && fieldOf[c] < 0) {
+            result.fatal = "missing required column '" + string(columns[c].name) + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool ValidUtf8(string_view s) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+    const unsigned char* end = p + s.size();
+    while (p < end) {
+        unsigned char c = *p++;
+        if (c < 0x80) continue;
+        int extra = c >= 0xF0 && c <= 0xF4 ? 3 : c >= 0xE0 ? 2 : c >= 0xC2 && c < 0xE0 ? 1 : -1;
+        if (extra < 0 || end - p < extra) return false;
+        unsigned char next = p[0];
+        // Overlong forms, surrogates and code points past U+10FFFF.
+        if ((c == 0xE0 && next < 0xA0) || (c == 0xED && next > 0x9F) ||
+            (c == 0xF0 && next < 0x90) || (c == 0xF4 && next > 0x8F)) {
+            return false;
+        }
+        for (int i = 0; i < extra; i++) {
+            if ((*p++ & 0xC0) != 0x80) return false;
+        }
+    }
+    return true;
+}
+
+inline string_view Trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Reads the fields of one row into a record, collecting the errors.
+class RowParser {
+private:
+    const CsvRow& row;
+    const vector<int>& fieldOf;
+    const CsvColumn* columns;
+    CsvImportResult& result;
+    bool valid = true;
+
+public:
+    RowParser(const CsvRow& r, const vector<int>& map, const CsvColumn* cols, CsvImportResult& res)
+        : row(r), fieldOf(map), columns(cols), result(res) {}
+
+    bool Valid() const { return valid; }
+
+    // The field for column, or null if the file has no such column.
+    const string* Field(int column) const {
+        if (column < 0) return nullptr;
+        int f = fieldOf[column];
+        return f >= 0 && size_t(f) < row.Size() ? &row[f] : nullptr;
+    }
+
+    bool Has(int column) const {
+        const string* field = Field(column);
+        return field && !Trim(*field).empty();
+    }
+
+    // column -1 is an error about the whole row.
+    void Error(int column, const string& reason) {
+        valid = false;
+        result.errorCount++;
+        if (result.errors.size() < CsvImportResult::MAX_REPORTED_ERRORS) {
+            const string* field = Field(column);
+            result.errors.push_back({row.line, column < 0 ? "" : columns[column].name, field ? *field : string(), reason});
+        }
+    }
+
+    template<typename N>
+    void Number(int column, N& target) {
+        if (!Has(column)) {
+            if (columns[column].required) Error(column, "missing value");
+            return;
+        }
+        string_view s = Trim(*Field(column));
+        const char* end = s.data() + s.size();
+        auto parsed = from_chars(s.data(), end, target);
+        if (parsed.ec != errc() || parsed.ptr != end) Error(column, "not a number");
+    }
+
+    void Flag(int column, bool& target) {
+        if (!Has(column)) {
+            if (columns[column].required) Error(column, "missing value");
+            return;
+        }
+        string key = Normalize(*Field(column));
+        if (key == "yes" || key == "y" || key == "true" || key == "1") target = true;
+        else if (key == "no" || key == "n" || key == "false" || key == "0") target = false;
+        else Error(column, "expected yes/no");
+    }
+
+    void Text(int column, string& target) {
+        const string* field = Field(column);
+        if (!field) return;
+        if (!ValidUtf8(*field)) {
+            Error(column, "not valid UTF-8");
+            return;
+        }
+        target = *field;
+    }
+
+    void Check(bool condition, int column, const char* reason) {
+        if (!condition) Error(column, reason);
+    }
+};
+
+}
+
+struct PipeCsv {
+    using Record = Pipe;
+    enum Column { Id, KmMark, Length, Diameter, Repair, ColumnCount };
+
+    static const CsvColumn* Columns() {
+        static const CsvColumn columns[ColumnCount] = {
+            {"id", "pipeid", false},
+            {"km_mark", "km|kilometermark|mark|name", true},
+            {"length", "lengthkm|len", true},
+            {"diameter", "diametr|diametermm|dn", true},
+            {"repair", "onrepair|inrepair|underrepair", false},
+        };
+        return columns;
+    }
+
+    static bool Parse(csv::RowParser& row, Pipe& pipe) {
+        pipe = Pipe{};
+        row.Number(Id, pipe.id);
+        row.Text(KmMark, pipe.km_mark);
+        row.Number(Length, pipe.length);
+        row.Number(Diameter, pipe.diametr);
+        row.Flag(Repair, pipe.repair);
+        if (!row.Valid()) return false;
+        row.Check(!row.Has(Id) || (pipe.id > 0 && pipe.id < INT_MAX), Id, "must be positive");
+        row.Check(isfinite(pipe.length) && pipe.length > 0, Length, "must be positive");
+        row.Check(pipe.diametr > 0, Diameter, "must be positive");
+        return row.Valid();
+    }
+
+    static void Write(CsvWriter& out, const Pipe& pipe) {
+        out.Number(pipe.id);
+        out.Field(pipe.km_mark);
+        out.Number(pipe.length);
+        out.Number(pipe.diametr);
+        out.Field(pipe.repair ? "yes" : "no");
+    }
+};
+
+struct CompressCsv {
+    using Record = Compress;
+    enum Column { Id, Name, Workshops, Working, Classification, Active, ColumnCount };
+
+    static const CsvColumn* Columns() {
+        static const CsvColumn columns[ColumnCount] = {
+            {"id", "csid|stationid", false},
+            {"name", "stationname", true},
+            {"workshops", "workshopcount|workshopquantity", true},
+            {"working_workshops", "workshopworking|workingcount", true},
+            {"classification", "class|type", false},
+            {"active", "isactive|inoperation|working", false},
+        };
+        return columns;
+    }
+
+    static bool Parse(csv::RowParser& row, Compress& station) {
+        station = Compress{};
+        row.Number(Id, station.id);
+        row.Text(Name, station.name);
+        row.Number(Workshops, station.workshop_count);
+        row.Number(Working, station.workshop_working);
+        row.Text(Classification, station.classification);
+        row.Flag(Active, station.working);
+        if (!row.Valid()) return false;
+        row.Check(!row.Has(Id) || (station.id > 0 && station.id < INT_MAX), Id, "must be positive");
+        row.Check(station.workshop_count >= 0, Workshops, "must not be negative");
+        row.Check(station.workshop_working >= 0 && station.workshop_working <= station.workshop_count,
+                  Working, "must be between 0 and the workshop count");
+        return row.Valid();
+    }
+
+    static void Write(CsvWriter& out, const Compress& station) {
+        out.Number(station.id);
+        out.Field(station.name);
+        out.Number(station.workshop_count);
+        out.Number(station.workshop_working);
+        out.Field(station.classification);
+        out.Field(station.working ? "yes" : "no");
+    }
+};
+
+// Records are handed to the manager's bulk path this many at a time, so
+// the memory an import takes doesn't depend on the file or on the data
+// already loaded. Each index decides whether a batch is worth a rebuild
+// (sorted_index.h).
+static constexpr size_t CSV_BATCH_ROWS = 65536;
+
+// Streams filename into manager. nextId is the manager's id counter;
+// rows without an id are numbered from it as their batch is flushed, so
+// a later row giving one of those ids collides. With replaceExisting a row
+// whose id is taken replaces that record (the last such row wins);
+// otherwise it's reported and skipped.
+template<typename Csv, typename Manager>
+CsvImportResult ImportCsv(const string& filename, Manager& manager, int& nextId, bool replaceExisting = false,
+                          size_t batchRows = CSV_BATCH_ROWS) {
+    using T = typename Csv::Record;
+    CsvImportResult result;
+    CsvReader reader;
+    if (!reader.Open(filename)) return result;
+    result.opened = true;
+
+    CsvRow row;
+    vector<int> fieldOf;
+    if (!reader.Next(row)) {
+        result.fatal = reader.Error().empty() ? "the file is empty" : reader.Error();
+        return result;
+    }
+    if (!csv::MapHeader(row, Csv::Columns(), Csv::ColumnCount, fieldOf, result)) return result;
+    const size_t headerFields = row.Size();
+
+    vector<T> batch;
+    batch.reserve(batchRows);
+    // Lines of the ids given in the batch; earlier batches are already in
+    // the manager.
+    unordered_map<int, size_t> batchLines;
+    auto flush = [&]() {
+        // Ids given in the batch claim their numbers first.
+        for (const T& item : batch) nextId = max(nextId, item.id + 1);
+        for (T& item : batch) {
+            if (item.id == 0) item.id = nextId++;
+        }
+        manager.AddRange(move(batch));
+        batch.clear();
+        batchLines.clear();
+    };
+
+    T item;
+    while (reader.Next(row)) {
+        result.rows++;
+        csv::RowParser parser(row, fieldOf, Csv::Columns(), result);
+        if (row.Size() != headerFields) {
+            parser.Error(-1, "expected " + to_string(headerFields) + " fields, found " + to_string(row.Size()));
+            result.skipped++;
+            continue;
+        }
+        if (!Csv::Parse(parser, item)) {
+            result.skipped++;
+            continue;
+        }
+        bool taken = false;
+        if (item.id != 0) {
+            auto earlier = batchLines.find(item.id);
+            bool inBatch = earlier != batchLines.end();
+            taken = inBatch || manager.Contains(manager.HandleOf(item.id));
+            if (taken && !replaceExisting) {
+                parser.Error(Csv::Id, inBatch ? "id repeats line " + to_string(earlier->second) : "id already exists");
+                result.skipped++;
+                continue;
+            }
+            batchLines[item.id] = row.line;
+        }
+        batch.push_back(move(item));
+        if (taken) result.replaced++;
+        else result.imported++;
+        if (batch.size() >= batchRows) flush();
+    }
+    if (!batch.empty()) flush();
+    if (!reader.Error().empty()) result.fatal = reader.Error();
+    return result;
+}
+
+// Writes every record of manager to filename through a temporary file.
+// Returns false if it can't be written.
+template<typename Csv, typename Manager>
+bool ExportCsv(const string& filename, const Manager& manager) {
+    string temp = TempPathFor(filename);
+    CsvWriter out;
+    if (!out.Open(temp)) return false;
+    const CsvColumn* columns = Csv::Columns();
+    for (size_t c = 0; c < Csv::ColumnCount; c++) out.Field(columns[c].name);
+    out.EndRow();
+    manager.ForEach([&](const typename Csv::Record& item) {
+        Csv::Write(out, item);
+        out.EndRow();
+    });
+    if (!out.Close() || !ReplaceFile(temp, filename)) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -4,163 +4,457 @@
 #include "pipe_manager.h"
 #include "compress_manager.h"
 #include "logger.h"
+#include "snapshot.h"
+#include "packed_snapshot.h"
+#include "backup_parser.h"
+#include "csv_records.h"
+#include "atomic_file.h"
 #include <fstream>
-#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
 #include <iomanip>
 #include <algorithm>
 
 using namespace std;
 
+// Text is the human-readable backup format; Binary is a snapshot.h
+// snapshot and Packed the smaller packed_snapshot.h encoding. Loading
+// detects the format from the file itself.
+enum class DataFormat { Text, Binary, Packed };
+
+struct SaveStatus {
+    bool running = false;
+    string filename;
+    size_t written = 0;   // records
+    size_t total = 0;
+};
+
+struct SaveResult {
+    string filename;
+    bool ok = false;
+    size_t pipes = 0;
+    size_t stations = 0;
+    double milliseconds = 0;
+};
+
 class FileManager {
 private:
     Logger& logger;
     string backupFile;
+    ExecutionMode loadMode = ExecutionMode::Parallel;
+    size_t parallelLoadBytes = DEFAULT_PARALLEL_LOAD_BYTES;
+    ThreadPool* pool = nullptr;
+
+    // Background save, one at a time. The job owns its copy of the data.
+    struct SaveJob {
+        string filename;
+        DataFormat format = DataFormat::Text;
+        string backupTime;
+        vector<Pipe> pipes;
+        vector<Compress> stations;
+        chrono::steady_clock::time_point started;
+    };
+
+    thread saver;
+    atomic<bool> saveRunning{false};
+    atomic<size_t> saveWritten{0};
+    atomic<size_t> saveTotal{0};
+    mutable mutex saveMutex;
+    string saveFilename;
+    SaveResult lastSave;
+    bool saveFinished = false;
 
 public:
+    // Text backups smaller than this are parsed on the calling thread.
+    static constexpr size_t DEFAULT_PARALLEL_LOAD_BYTES = 8 << 20;
+
     FileManager(Logger& log, const string& filename = "data_backup.txt") 
         : logger(log), backupFile(filename) {}
 
+    FileManager(const FileManager&) = delete;
+    FileManager& operator=(const FileManager&) = delete;
+
+    ~FileManager() { WaitForSave(); }
+
+    void SetLoadMode(ExecutionMode mode) { loadMode = mode; }
+    ExecutionMode GetLoadMode() const { return loadMode; }
+    void SetParallelLoadThreshold(size_t bytes) { parallelLoadBytes = bytes; }
+    // Defaults to ThreadPool::Shared().
+    void SetThreadPool(ThreadPool& p) { pool = &p; }
+
+    // Files ending in ".bin" get the binary format, ".pack" the packed one.
+    static DataFormat FormatFor(const string& filename) {
+        auto endsWith = [&](const string& ext) {
+            return filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+        };
+        if (endsWith(".bin")) return DataFormat::Binary;
+        if (endsWith(".pack")) return DataFormat::Packed;
+        return DataFormat::Text;
+    }
+
     void SaveAllData(const PipeManager& pipeManager, const CompressManager& compressManager, const string& customFilename = "") {
         string filename = customFilename.empty() ? backupFile : customFilename;
-        
-        ofstream file(filename);
-        if (!file.is_open()) {
-            cout << "Error: Could not open file for saving data.\n";
-            logger.Log("ERROR: Failed to save all data - file open error");
+        SaveAllData(pipeManager, compressManager, filename, FormatFor(filename));
+    }
+
+    void SaveAllData(const PipeManager& pipeManager, const CompressManager& compressManager,
+                     const string& filename, DataFormat format) {
+        if (!StorageReadable(pipeManager, compressManager, filename)) return;
+        vector<Pipe> pipeCopy;
+        vector<Compress> stationCopy;
+        const vector<Pipe>& pipes = pipeManager.Records(pipeCopy);
+        const vector<Compress>& stations = compressManager.Records(stationCopy);
+        if (!WriteData(filename, format, logger.GetCurrentDateTime(), pipes, stations, nullptr)) {
+            cout << "Error: Could not save data to " << filename << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Failed to save all data - could not write " + filename);
             return;
         }
+        cout << "All data saved successfully to " << filename << "\n";
+        logger.Log(LogEvent::SavedAllData, pipes.size(), stations.size(), filename);
+    }
 
-        file << "===== DATA BACKUP =====\n";
-        file << "Backup time: " << logger.GetCurrentDateTime() << "\n";
-        file << "======================================\n\n";
+    // Copies both managers (a consistent point-in-time view) and writes
+    // the copy on a background thread, so editing can go on meanwhile.
+    // Returns false if a background save is still running or the data
+    // can't all be read.
+    bool SaveAllDataAsync(const PipeManager& pipeManager, const CompressManager& compressManager, const string& customFilename = "") {
+        if (saveRunning) return false;
+        if (saver.joinable()) saver.join();
 
-        SavePipes(file, pipeManager.GetAll());
-        SaveCompress(file, compressManager.GetAll());
+        string filename = customFilename.empty() ? backupFile : customFilename;
+        if (!StorageReadable(pipeManager, compressManager, filename)) return false;
+        auto job = make_shared<SaveJob>();
+        job->filename = filename;
+        job->format = FormatFor(job->filename);
+        job->backupTime = logger.GetCurrentDateTime();
+        job->pipes = pipeManager.CopyAll();
+        job->stations = compressManager.CopyAll();
+        job->started = chrono::steady_clock::now();
 
-        file.close();
-        
-        cout << "All data saved successfully to " << filename << "\n";
-        stringstream ss;
-        ss << "SAVED ALL DATA - Pipes: " << pipeManager.GetAll().size() << ", CS: " 
-           << compressManager.GetAll().size() << " exported to " << filename;
-        logger.Log(ss.str());
+        {
+            lock_guard<mutex> lock(saveMutex);
+            saveFilename = job->filename;
+        }
+        saveWritten = 0;
+        saveTotal = job->pipes.size() + job->stations.size();
+        saveRunning = true;
+        saver = thread([this, job] { RunSave(*job); });
+        return true;
+    }
+
+    SaveStatus GetSaveStatus() const {
+        SaveStatus status;
+        status.running = saveRunning;
+        status.written = saveWritten;
+        status.total = saveTotal;
+        lock_guard<mutex> lock(saveMutex);
+        status.filename = saveFilename;
+        return status;
+    }
+
+    // Hands out the result of a finished background save, once.
+    bool TakeSaveResult(SaveResult& result) {
+        lock_guard<mutex> lock(saveMutex);
+        if (!saveFinished) return false;
+        result = lastSave;
+        saveFinished = false;
+        return true;
+    }
+
+    void WaitForSave() {
+        if (saver.joinable()) saver.join();
     }
 
     void LoadAllData(PipeManager& pipeManager, CompressManager& compressManager, 
                      int& nextPipeId, int& nextCompressId, const string& customFilename = "") {
         string filename = customFilename.empty() ? backupFile : customFilename;
-        
-        ifstream file(filename);
-        if (!file.is_open()) {
+        WaitForSave();
+
+        if (IsSnapshotFile(filename)) {
+            LoadSnapshot(pipeManager, compressManager, nextPipeId, nextCompressId, filename);
+            return;
+        }
+        if (IsPackedSnapshotFile(filename)) {
+            LoadPackedSnapshot(pipeManager, compressManager, nextPipeId, nextCompressId, filename);
+            return;
+        }
+
+        MappedFile file;
+        if (!file.Open(filename)) {
             cout << "Error: Could not open " << filename << ". File not found.\n";
-            logger.Log("ERROR: Failed to load data - file not found: " + filename);
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Failed to load data - file not found: " + filename);
             return;
         }
 
+        // One result per parsed piece of the file, in file order.
+        vector<BackupParseResult> parsed;
+        string_view text(file.Data(), file.Size());
+        if (loadMode == ExecutionMode::Parallel && text.size() >= parallelLoadBytes) {
+            parsed = ParseBackupParallel(text, pool ? *pool : ThreadPool::Shared());
+        } else {
+            parsed.resize(1);
+            BackupParser(parsed[0]).Parse(text);
+        }
+        file.Close();
+        DropDuplicateBackupIds(parsed);
+        ReportParseErrors(parsed, filename);
+
         pipeManager.Clear();
         compressManager.Clear();
 
-        string line;
-        int loadedPipes = 0;
-        int loadedStations = 0;
-        int maxPipeId = 0;
-        int maxStationId = 0;
-
-        bool inPipeSection = false;
-        bool inStationSection = false;
-
-        Pipe currentPipe = {};
-        Compress currentStation = {};
-        bool inPipe = false;
-        bool inStation = false;
-
-        while (getline(file, line)) {
-            if (line.find("===== PIPES DATA =====") != string::npos) {
-                inPipeSection = true;
-                inStationSection = false;
-                continue;
+        vector<vector<Pipe>> pipeBatches;
+        vector<vector<Compress>> stationBatches;
+        for (auto& part : parsed) {
+            pipeBatches.push_back(move(part.pipes));
+            stationBatches.push_back(move(part.stations));
+        }
+        // Saved ids are kept; AddRange moves the counters past the largest.
+        nextPipeId = 1;
+        nextCompressId = 1;
+        size_t loadedPipes = pipeManager.AddRange(move(pipeBatches));
+        size_t loadedStations = compressManager.AddRange(move(stationBatches));
+
+        cout << "All data loaded successfully!\n";
+        cout << "Pipes loaded: " << loadedPipes << "\n";
+        cout << "CS loaded: " << loadedStations << "\n";
+
+        logger.Log(LogEvent::LoadedAllData, loadedPipes, loadedStations, filename);
+    }
+
+    // CSV exchange (csv_records.h). Imports add to the current data; rows
+    // with a known id replace that record only if replaceExisting.
+    void ImportPipesCsv(PipeManager& pipeManager, int& nextPipeId, const string& filename, bool replaceExisting) {
+        ImportCsvFile<PipeCsv>(pipeManager, nextPipeId, filename, replaceExisting, "pipes");
+    }
+
+    void ImportCompressCsv(CompressManager& compressManager, int& nextCompressId, const string& filename,
+                           bool replaceExisting) {
+        ImportCsvFile<CompressCsv>(compressManager, nextCompressId, filename, replaceExisting, "CS");
+    }
+
+    void ExportPipesCsv(const PipeManager& pipeManager, const string& filename) {
+        ExportCsvFile<PipeCsv>(pipeManager, filename, "pipes");
+    }
+
+    void ExportCompressCsv(const CompressManager& compressManager, const string& filename) {
+        ExportCsvFile<CompressCsv>(compressManager, filename, "CS");
+    }
+
+private:
+    // Writes to a temporary file and replaces filename with it, so a
+    // crash mid-save never leaves a half-written backup. written, if
+    // given, is advanced as text records go out.
+    bool WriteData(const string& filename, DataFormat format, const string& backupTime,
+                   const vector<Pipe>& pipes, const vector<Compress>& stations, atomic<size_t>* written) {
+        string temp = TempPathFor(filename);
+        if (format == DataFormat::Binary) {
+            if (!WriteSnapshot(temp, pipes, stations)) {
+                remove(temp.c_str());
+                return false;
             }
-            if (line.find("===== COMPRESSOR STATIONS DATA =====") != string::npos) {
-                if (inPipe && currentPipe.id > 0) {
-                    pipeManager.Add(currentPipe);
-                    maxPipeId = max(maxPipeId, currentPipe.id);
-                    loadedPipes++;
-                    inPipe = false;
-                }
-                inPipeSection = false;
-                inStationSection = true;
-                continue;
+            if (written) *written = pipes.size() + stations.size();
+        } else if (format == DataFormat::Packed) {
+            if (!WritePackedSnapshot(temp, pipes, stations)) {
+                remove(temp.c_str());
+                return false;
             }
+            if (written) *written = pipes.size() + stations.size();
+        } else {
+            ofstream file(temp, ios::trunc);
+            if (!file.is_open()) return false;
 
-            if (line.empty() || line.find("=====") != string::npos || 
-                line.find("Total") != string::npos || line.find("------") != string::npos) {
-                continue;
-            }
+            file << "===== DATA BACKUP =====\n";
+            file << "Backup time: " << backupTime << "\n";
+            file << "======================================\n\n";
 
-            try {
-                if (inPipeSection && line.find("~~~") != string::npos) {
-                    if (inPipe && currentPipe.id > 0) {
-                        pipeManager.Add(currentPipe);
-                        maxPipeId = max(maxPipeId, currentPipe.id);
-                        loadedPipes++;
-                        inPipe = false;
-                    }
-                    continue;
-                }
-
-                if (inStationSection && line.find("~~~") != string::npos) {
-                    if (inStation && currentStation.id > 0) {
-                        compressManager.Add(currentStation);
-                        maxStationId = max(maxStationId, currentStation.id);
-                        loadedStations++;
-                        inStation = false;
-                    }
-                    continue;
-                }
-
-                if (inPipeSection) {
-                    ParsePipeLine(line, currentPipe, inPipe);
-                } else if (inStationSection) {
-                    ParseCompressLine(line, currentStation, inStation);
-                }
-            } catch (...) {
-                logger.Log("WARNING: Skipped invalid line while loading data");
+            SavePipes(file, pipes, written);
+            SaveCompress(file, stations, written);
+
+            file.close();
+            if (file.fail()) {
+                remove(temp.c_str());
+                return false;
             }
         }
+        return ReplaceFile(temp, filename);
+    }
 
-        // Add last items if exist
-        if (inPipe && currentPipe.id > 0) {
-            pipeManager.Add(currentPipe);
-            maxPipeId = max(maxPipeId, currentPipe.id);
-            loadedPipes++;
+    void RunSave(const SaveJob& job) {
+        bool ok = WriteData(job.filename, job.format, job.backupTime, job.pipes, job.stations, &saveWritten);
+        if (ok) {
+            logger.Log(LogEvent::SavedAllData, job.pipes.size(), job.stations.size(), job.filename);
+        } else {
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Failed to save all data - could not write " + job.filename);
         }
-        if (inStation && currentStation.id > 0) {
-            compressManager.Add(currentStation);
-            maxStationId = max(maxStationId, currentStation.id);
-            loadedStations++;
+
+        lock_guard<mutex> lock(saveMutex);
+        lastSave.filename = job.filename;
+        lastSave.ok = ok;
+        lastSave.pipes = job.pipes.size();
+        lastSave.stations = job.stations.size();
+        lastSave.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - job.started).count();
+        saveFinished = true;
+        saveRunning = false;
+    }
+
+    // The snapshot is validated completely before the managers are
+    // cleared, so a damaged file leaves the current data untouched.
+    void LoadSnapshot(PipeManager& pipeManager, CompressManager& compressManager,
+                      int& nextPipeId, int& nextCompressId, const string& filename) {
+        SnapshotReader snapshot;
+        if (!snapshot.Open(filename)) {
+            cout << "Error: Could not load " << filename << ": " << snapshot.Error() << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage,
+                       "ERROR: Failed to load snapshot " + filename + " - " + snapshot.Error());
+            return;
         }
 
-        file.close();
-        
-        nextPipeId = maxPipeId + 1;
-        nextCompressId = maxStationId + 1;
-        
+        pipeManager.Clear();
+        compressManager.Clear();
+
+        vector<Pipe> pipes(snapshot.PipeCount());
+        for (size_t i = 0; i < pipes.size(); i++) pipes[i] = snapshot.PipeAt(i);
+        vector<Compress> stations(snapshot.StationCount());
+        for (size_t i = 0; i < stations.size(); i++) stations[i] = snapshot.StationAt(i);
+
+        nextPipeId = 1;
+        nextCompressId = 1;
+        size_t loadedPipes = pipeManager.AddRange(move(pipes));
+        size_t loadedStations = compressManager.AddRange(move(stations));
+
         cout << "All data loaded successfully!\n";
         cout << "Pipes loaded: " << loadedPipes << "\n";
         cout << "CS loaded: " << loadedStations << "\n";
-        
-        stringstream ss;
-        ss << "LOADED ALL DATA - Pipes: " << loadedPipes << ", CS: " << loadedStations 
-           << " imported from " << filename;
-        logger.Log(ss.str());
+
+        logger.Log(LogEvent::LoadedAllData, loadedPipes, loadedStations, filename);
     }
 
-private:
-    void SavePipes(ofstream& file, const vector<Pipe>& pipes) {
+    // Like LoadSnapshot: the whole file is decoded before anything changes.
+    void LoadPackedSnapshot(PipeManager& pipeManager, CompressManager& compressManager,
+                            int& nextPipeId, int& nextCompressId, const string& filename) {
+        PackedSnapshotReader snapshot;
+        if (!snapshot.Open(filename)) {
+            cout << "Error: Could not load " << filename << ": " << snapshot.Error() << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage,
+                       "ERROR: Failed to load packed snapshot " + filename + " - " + snapshot.Error());
+            return;
+        }
+
+        pipeManager.Clear();
+        compressManager.Clear();
+
+        nextPipeId = 1;
+        nextCompressId = 1;
+        size_t loadedPipes = pipeManager.AddRange(move(snapshot.Pipes()));
+        size_t loadedStations = compressManager.AddRange(move(snapshot.Stations()));
+
+        cout << "All data loaded successfully!\n";
+        cout << "Pipes loaded: " << loadedPipes << "\n";
+        cout << "CS loaded: " << loadedStations << "\n";
+
+        logger.Log(LogEvent::LoadedAllData, loadedPipes, loadedStations, filename);
+    }
+
+    // Records of a failed paged store that can't be read are left out of
+    // copies, so saving them would replace a good file with a partial one.
+    bool StorageReadable(const PipeManager& pipeManager, const CompressManager& compressManager, const string& filename) {
+        if (!pipeManager.StorageFailed() && !compressManager.StorageFailed()) return true;
+        cout << "Error: Could not save data to " << filename << ": the paged data file has read or write errors.\n";
+        logger.Log(LogLevel::Error, LogCategory::Storage,
+                   "ERROR: Failed to save all data - paged storage I/O error, " + filename + " left unchanged");
+        return false;
+    }
+
+    template<typename Csv, typename Manager>
+    void ImportCsvFile(Manager& manager, int& nextId, const string& filename, bool replaceExisting, const char* what) {
+        WaitForSave();
+        auto started = chrono::steady_clock::now();
+        CsvImportResult result = ImportCsv<Csv>(filename, manager, nextId, replaceExisting);
+        if (!result.opened) {
+            cout << "Error: Could not open " << filename << ". File not found.\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Failed to import CSV - file not found: " + filename);
+            return;
+        }
+
+        for (const auto& column : result.ignoredColumns) {
+            cout << "Warning: " << filename << ": unknown column '" << column << "' ignored\n";
+        }
+        for (const auto& error : result.errors) {
+            cout << "Warning: " << filename << ":" << error.line << ": ";
+            if (!error.column.empty()) cout << error.column << " '" << error.value << "' ";
+            cout << error.reason << "\n";
+        }
+        if (result.errorCount > result.errors.size()) {
+            cout << "Warning: " << result.errorCount - result.errors.size() << " more invalid values\n";
+        }
+        if (!result.fatal.empty()) {
+            cout << "Error: Import from " << filename << " stopped: " << result.fatal << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage,
+                       "ERROR: CSV import from " + filename + " stopped - " + result.fatal);
+            if (result.rows == 0) return;
+        }
+        if (result.skipped > 0) {
+            const CsvRowError& first = result.errors.front();
+            logger.Log(LogLevel::Warning, LogCategory::Storage,
+                       "WARNING: Skipped " + to_string(result.skipped) + " invalid row(s) importing " + filename +
+                       " - first at line " + to_string(first.line) + ": " + first.reason);
+        }
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        cout << "Imported " << result.imported << " new " << what << " from " << filename << " in " << fixed
+             << setprecision(2) << seconds << " s (" << result.replaced << " replaced, " << result.skipped
+             << " row(s) skipped).\n";
+        logger.Log(LogEvent::ImportedCsv, what, result.imported, result.replaced, result.skipped, filename);
+    }
+
+    template<typename Csv, typename Manager>
+    void ExportCsvFile(const Manager& manager, const string& filename, const char* what) {
+        if (!ExportCsv<Csv>(filename, manager)) {
+            cout << "Error: Could not export " << what << " to " << filename << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Failed to export CSV - could not write " + filename);
+            return;
+        }
+        cout << "Exported " << manager.Size() << " " << what << " to " << filename << "\n";
+        logger.Log(LogEvent::ExportedCsv, what, manager.Size(), filename);
+    }
+
+    void ReportParseErrors(const vector<BackupParseResult>& parsed, const string& filename) {
+        size_t errorCount = 0, skipped = 0, shown = 0;
+        const BackupParseError* first = nullptr;
+        for (const auto& part : parsed) {
+            errorCount += part.errorCount;
+            skipped += part.skippedRecords;
+            for (const auto& error : part.errors) {
+                if (!first) first = &error;
+                if (shown == BackupParseResult::MAX_REPORTED_ERRORS) break;
+                cout << "Warning: " << filename << ":" << error.line << ": " << error.reason << " " << error.field
+                     << " '" << error.value << "'\n";
+                shown++;
+            }
+        }
+        if (errorCount == 0) return;
+        if (errorCount > shown) {
+            cout << "Warning: " << errorCount - shown << " more invalid values\n";
+        }
+        cout << "Skipped " << skipped << " invalid record(s).\n";
+
+        logger.Log(LogLevel::Warning, LogCategory::Storage,
+                   "WARNING: Skipped " + to_string(skipped) + " invalid record(s) loading " + filename +
+                   " - first at line " + to_string(first->line) + ", " + first->field + ": '" + first->value + "'");
+    }
+
+    // Progress is published every PROGRESS_STEP records.
+    static constexpr size_t PROGRESS_STEP = 4096;
+
+    void SavePipes(ofstream& file, const vector<Pipe>& pipes, atomic<size_t>* written) {
         file << "===== PIPES DATA =====\n";
         file << "Total pipes: " << pipes.size() << "\n";
         file << "--------------------------------------\n\n";
         
+        size_t done = 0;
         for (const auto& pipe : pipes) {
             file << "ID: " << pipe.id << "\n";
             file << "KM Mark: " << pipe.km_mark << "\n";
@@ -168,14 +462,17 @@ private:
             file << "Diameter (mm): " << pipe.diametr << "\n";
             file << "On repair: " << (pipe.repair ? "Yes" : "No") << "\n";
             file << "~~~\n\n";
+            if (written && ++done % PROGRESS_STEP == 0) *written += PROGRESS_STEP;
         }
+        if (written) *written += done % PROGRESS_STEP;
     }
 
-    void SaveCompress(ofstream& file, const vector<Compress>& stations) {
+    void SaveCompress(ofstream& file, const vector<Compress>& stations, atomic<size_t>* written) {
         file << "\n===== COMPRESSOR STATIONS DATA =====\n";
         file << "Total stations: " << stations.size() << "\n";
         file << "--------------------------------------\n\n";
         
+        size_t done = 0;
         for (const auto& station : stations) {
             file << "ID: " << station.id << "\n";
             file << "Name: " << station.name << "\n";
@@ -184,48 +481,9 @@ private:
             file << "Classification: " << station.classification << "\n";
             file << "Active: " << (station.working ? "Yes" : "No") << "\n";
             file << "~~~\n\n";
+            if (written && ++done % PROGRESS_STEP == 0) *written += PROGRESS_STEP;
         }
-    }
-
-    void ParsePipeLine(const string& line, Pipe& pipe, bool& inPipe) {
-        if (line.find("ID: ") == 0) {
-            pipe.id = stoi(line.substr(4));
-            inPipe = true;
-        }
-        else if (line.find("KM Mark: ") == 0 && inPipe) {
-            pipe.km_mark = line.substr(9);
-        }
-        else if (line.find("Length (km): ") == 0 && inPipe) {
-            pipe.length = stod(line.substr(13));
-        }
-        else if (line.find("Diameter (mm): ") == 0 && inPipe) {
-            pipe.diametr = stoi(line.substr(15));
-        }
-        else if (line.find("On repair: ") == 0 && inPipe) {
-            pipe.repair = (line.substr(11) == "Yes");
-        }
-    }
-
-    void ParseCompressLine(const string& line, Compress& station, bool& inStation) {
-        if (line.find("ID: ") == 0) {
-            station.id = stoi(line.substr(4));
-            inStation = true;
-        }
-        else if (line.find("Name: ") == 0 && inStation) {
-            station.name = line.substr(6);
-        }
-        else if (line.find("Workshops: ") == 0 && inStation) {
-            station.workshop_count = stoi(line.substr(11));
-        }
-        else if (line.find("Working: ") == 0 && inStation) {
-            station.workshop_working = stoi(line.substr(9));
-        }
-        else if (line.find("Classification: ") == 0 && inStation) {
-            station.classification = line.substr(16);
-        }
-        else if (line.find("Active: ") == 0 && inStation) {
-            station.working = (line.substr(8) == "Yes");
-        }
+        if (written) *written += done % PROGRESS_STEP;
     }
 };
 
@@ -2,54 +2,304 @@
 #define GENERIC_MANAGER_H
 
 #include "logger.h"
+#include "id_index.h"
+#include "slot_map.h"
+#include "paged_store.h"
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 
 using namespace std;
 
+// Receives every change to a manager's storage, in storage positions.
+// OnErased is called before the record at position is removed and the
+// record at lastPosition is moved into its place. OnInsertedRange
+// reports count records inserted at firstPosition onwards in one go;
+// listeners that can build their structures in bulk override it.
+template<typename T>
+class ManagerListener {
+public:
+    virtual ~ManagerListener() = default;
+    virtual void OnInserted(const T& item, size_t position) = 0;
+    virtual void OnInsertedRange(const T* values, size_t count, size_t firstPosition) {
+        for (size_t i = 0; i < count; i++) OnInserted(values[i], firstPosition + i);
+    }
+    virtual void OnErased(const T& item, size_t position, size_t lastPosition) = 0;
+    virtual void OnUpdated(const T& before, const T& after, size_t position) = 0;
+    virtual void OnCleared() = 0;
+};
+
+// Records live in a slot map: storage is contiguous, Delete is O(1)
+// (swap with last), and Handles stay valid across other deletes.
+// Pointers from FindById/Get are const and only valid until the next
+// Add/Delete; records change only through Update(), so listeners stay
+// in sync.
+//
+// With UsePagedStorage() the records move to a PagedStore instead, with
+// the same positions and handles semantics; only a bounded pool of pages
+// stays in memory. Reads then decode a copy, so a pointer from
+// FindById/Get also expires after a few more reads (paged_store.h).
 template<typename T>
 class GenericManager {
 protected:
-    vector<T> items;
+    SlotMap<T> items;
+    unique_ptr<PagedStore<T>> paged;  // set when records are paged out
+    IdIndex index;                // id -> slot
+    vector<ManagerListener<T>*> listeners;
     int& nextId;
     Logger& logger;
 
 public:
     GenericManager(int& id, Logger& log) : nextId(id), logger(log) {}
+    GenericManager(const GenericManager&) = delete;
+    GenericManager& operator=(const GenericManager&) = delete;
 
     virtual ~GenericManager() = default;
 
-    void Add(const T& item) {
+    Handle Add(const T& item) {
         T newItem = item;
         newItem.id = nextId++;
-        items.push_back(newItem);
+        Handle h = paged ? paged->Insert(newItem) : items.Insert(newItem);
+        index.Set(newItem.id, (int)h.slot);
+        for (auto* listener : listeners) listener->OnInserted(newItem, Size() - 1);
         OnAdd(newItem);
+        return h;
+    }
+
+    // Stores item under its own id, replacing any record with that id,
+    // and moves nextId past it. Used to restore saved state, so OnAdd is
+    // not called.
+    Handle Insert(const T& item) {
+        if (item.id >= nextId) nextId = item.id + 1;
+        Handle h = HandleOf(item.id);
+        if (Contains(h)) {
+            Update(item);
+            return h;
+        }
+        h = paged ? paged->Insert(item) : items.Insert(item);
+        index.Set(item.id, (int)h.slot);
+        for (auto* listener : listeners) listener->OnInserted(item, Size() - 1);
+        return h;
+    }
+
+    // Bulk ingest for loads: records keep their ids (as with Insert),
+    // storage is reserved up front, listeners see the new records in one
+    // OnInsertedRange call and a single summary is logged instead of one
+    // OnAdd per record. Returns the number of new records.
+    template<typename It>
+    size_t AddRange(It first, It last) {
+        size_t start = Size();
+        BeginRange(start + size_t(distance(first, last)));
+        for (; first != last; ++first) Ingest(*first, start);
+        return EndRange(start);
     }
 
-    T* FindById(int id) {
-        for (auto& item : items) {
-            if (item.id == id) return &item;
+    size_t AddRange(vector<T>&& batch) {
+        return AddRange(make_move_iterator(batch.begin()), make_move_iterator(batch.end()));
+    }
+
+    size_t AddRange(const vector<T>& batch) { return AddRange(batch.begin(), batch.end()); }
+
+    // Several batches as one range, e.g. the pieces of a parallel parse.
+    size_t AddRange(vector<vector<T>>&& batches) {
+        size_t start = Size();
+        size_t total = start;
+        for (const auto& batch : batches) total += batch.size();
+        BeginRange(total);
+        for (auto& batch : batches) {
+            for (auto& item : batch) Ingest(move(item), start);
         }
-        return nullptr;
+        return EndRange(start);
+    }
+
+    Handle HandleOf(int id) const {
+        int slot = index.Find(id);
+        if (slot == IdIndex::npos) return Handle{};
+        return paged ? paged->HandleOfSlot((uint32_t)slot) : items.HandleOfSlot((uint32_t)slot);
     }
 
+    Handle HandleAt(size_t position) const { return paged ? paged->HandleAt(position) : items.HandleAt(position); }
+    bool Contains(Handle h) const { return paged ? paged->Contains(h) : items.Contains(h); }
+
+    const T* Get(Handle h) const { return paged ? paged->Get(h) : items.Get(h); }
+    const T* FindById(int id) const { return Get(HandleOf(id)); }
+
     bool Delete(int id) {
-        for (size_t i = 0; i < items.size(); i++) {
-            if (items[i].id == id) {
-                OnDelete(items[i]);
-                items.erase(items.begin() + i);
-                return true;
-            }
+        Handle h = HandleOf(id);
+        const T* item = Get(h);
+        if (!item) return false;
+
+        OnDelete(*item);
+        for (auto* listener : listeners) listener->OnErased(*item, PositionOf(h), Size() - 1);
+        index.Erase(id);
+        if (paged) paged->Erase(h);
+        else items.Erase(h);
+        return true;
+    }
+
+    // Replaces the stored record with the same id and notifies listeners.
+    bool Update(const T& item) {
+        Handle h = HandleOf(item.id);
+        const T* current = Get(h);
+        if (!current) return false;
+
+        for (auto* listener : listeners) listener->OnUpdated(*current, item, PositionOf(h));
+        if (paged) paged->Assign(h, item);
+        else *items.Get(h) = item;
+        return true;
+    }
+
+    // A new listener is brought up to date with the current records.
+    void Subscribe(ManagerListener<T>* listener) {
+        listener->OnCleared();
+        NotifyInserted({listener}, 0);
+        listeners.push_back(listener);
+    }
+
+    void Unsubscribe(ManagerListener<T>* listener) {
+        listeners.erase(remove(listeners.begin(), listeners.end(), listener), listeners.end());
+    }
+
+    // Calls f(record, position) for positions [begin, end) in storage
+    // order. Read-only scans may run it from several threads at once.
+    template<typename F>
+    void ForEachInRange(size_t begin, size_t end, F f) const {
+        if (paged) {
+            paged->ForEachInRange(begin, end, f);
+            return;
         }
-        return false;
+        const auto& values = items.Values();
+        for (size_t i = begin; i < end; i++) f(values[i], i);
     }
 
-    vector<T>& GetAll() { return items; }
-    const vector<T>& GetAll() const { return items; }
-    void Clear() { items.clear(); }
+    template<typename F>
+    void ForEach(F f) const {
+        ForEachInRange(0, Size(), [&f](const T& item, size_t) { f(item); });
+    }
+
+    // All records as one vector: the storage itself when it's in memory,
+    // otherwise a copy made in scratch.
+    const vector<T>& Records(vector<T>& scratch) const {
+        if (!paged) return items.Values();
+        scratch.clear();
+        scratch.reserve(Size());
+        ForEach([&scratch](const T& item) { scratch.push_back(item); });
+        return scratch;
+    }
+
+    vector<T> CopyAll() const {
+        if (!paged) return items.Values();
+        vector<T> copy;
+        Records(copy);
+        return copy;
+    }
+
+    size_t Size() const { return paged ? paged->Size() : items.Size(); }
+    bool Empty() const { return Size() == 0; }
+
+    void Clear() {
+        if (paged) paged->Clear();
+        else items.Clear();
+        index.Clear();
+        for (auto* listener : listeners) listener->OnCleared();
+    }
+
+    // Moves the records into a paged data file; from then on at most
+    // config.poolBytes of them are held in memory. Returns false, leaving
+    // the records in memory, if the file can't be created. Positions are
+    // kept, so listeners are unaffected, but older Handles are not.
+    bool UsePagedStorage(const PagedStorageConfig& config) {
+        auto store = make_unique<PagedStore<T>>();
+        if (!store->Open(config)) return false;
+        store->Reserve(Size());
+        index.Clear();
+        ForEach([&](const T& item) { index.Set(item.id, (int)store->Insert(item).slot); });
+        items = SlotMap<T>();
+        paged = move(store);
+        return true;
+    }
+
+    // Brings paged records back into memory.
+    void UseMemoryStorage() {
+        if (!paged) return;
+        SlotMap<T> memory;
+        memory.Reserve(Size());
+        index.Clear();
+        ForEach([&](const T& item) { index.Set(item.id, (int)memory.Insert(item).slot); });
+        items = move(memory);
+        paged.reset();
+    }
+
+    // The paged store, or nullptr while records are in memory.
+    const PagedStore<T>* Paged() const { return paged.get(); }
+
+    // True once a paged read or write failed (paged_store.h). Scans then
+    // skip the records they can't read.
+    bool StorageFailed() const { return paged && paged->Failed(); }
 
 protected:
     virtual void OnAdd(const T& item) = 0;
+    virtual void OnAddRange(size_t count) = 0;
     virtual void OnDelete(const T& item) = 0;
+
+private:
+    // Listeners are told about paged records a chunk at a time, so the
+    // decoded copies stay small.
+    static constexpr size_t NOTIFY_CHUNK = 65536;
+
+    size_t PositionOf(Handle h) const { return paged ? paged->PositionOf(h) : items.PositionOf(h); }
+
+    // Reports the records from position start onwards to targets.
+    void NotifyInserted(const vector<ManagerListener<T>*>& targets, size_t start) {
+        if (!paged) {
+            if (start == items.Size()) return;
+            for (auto* listener : targets) {
+                listener->OnInsertedRange(items.Values().data() + start, items.Size() - start, start);
+            }
+            return;
+        }
+        vector<T> chunk;
+        for (size_t first = start; first < Size(); first += NOTIFY_CHUNK) {
+            chunk.clear();
+            paged->ForEachInRange(first, min(Size(), first + NOTIFY_CHUNK),
+                [&chunk](const T& item, size_t) { chunk.push_back(item); });
+            for (auto* listener : targets) listener->OnInsertedRange(chunk.data(), chunk.size(), first);
+        }
+    }
+
+    void BeginRange(size_t expectedSize) {
+        if (paged) paged->Reserve(expectedSize);
+        else items.Reserve(expectedSize);
+        index.Reserve(nextId + int(expectedSize - Size()), expectedSize);
+    }
+
+    // Stores one record of a range. A record whose id is already known
+    // before the range replaces it through Update; a repeated id within
+    // the range just overwrites the copy listeners haven't seen yet.
+    template<typename V>
+    void Ingest(V&& item, size_t start) {
+        int id = item.id;
+        if (id >= nextId) nextId = id + 1;
+        Handle h = HandleOf(id);
+        if (Contains(h)) {
+            if (PositionOf(h) < start) Update(item);
+            else if (paged) paged->Assign(h, item);
+            else *items.Get(h) = forward<V>(item);
+            return;
+        }
+        h = paged ? paged->Insert(item) : items.Insert(forward<V>(item));
+        index.Set(id, (int)h.slot);
+    }
+
+    size_t EndRange(size_t start) {
+        size_t added = Size() - start;
+        if (added == 0) return 0;
+        NotifyInserted(listeners, start);
+        OnAddRange(added);
+        return added;
+    }
 };
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef ID_INDEX_H
+#define ID_INDEX_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace std;
+
+// Maps record id -> slot. Ids issued by nextId++ are dense and go to a
+// direct-addressed table; ids far outside it (e.g. after loading a backup
+// with gaps) fall back to a hash map.
+class IdIndex {
+private:
+    static constexpr size_t DENSE_SLACK = 1024;
+
+    vector<int> dense;
+    unordered_map<int, int> sparse;
+    size_t count = 0;
+
+public:
+    static constexpr int npos = -1;
+
+    int Find(int id) const {
+        if (id >= 0 && (size_t)id < dense.size() && dense[id] != npos) {
+            return dense[id];
+        }
+        if (!sparse.empty()) {
+            auto it = sparse.find(id);
+            if (it != sparse.end()) return it->second;
+        }
+        return npos;
+    }
+
+    void Set(int id, int slot) {
+        if (Find(id) == npos) count++;
+        if (id >= 0 && (size_t)id >= dense.size() && (size_t)id < 2 * count + DENSE_SLACK) {
+            dense.resize(max((size_t)id + 1, dense.size() * 2), npos);
+        }
+        if (id >= 0 && (size_t)id < dense.size()) {
+            dense[id] = slot;
+            if (!sparse.empty()) sparse.erase(id);
+        } else {
+            sparse[id] = slot;
+        }
+    }
+
+    // Sizes the dense table for ids up to maxId ahead of a bulk insert,
+    // if expectedCount records would fill it as densely as Set() expects.
+    void Reserve(int maxId, size_t expectedCount) {
+        if (maxId < 0 || (size_t)maxId >= 2 * expectedCount + DENSE_SLACK) return;
+        if ((size_t)maxId >= dense.size()) dense.resize((size_t)maxId + 1, npos);
+    }
+
+    void Erase(int id) {
+        if (Find(id) == npos) return;
+        count--;
+        if (id >= 0 && (size_t)id < dense.size()) dense[id] = npos;
+        if (!sparse.empty()) sparse.erase(id);
+    }
+
+    void Clear() {
+        dense.clear();
+        sparse.clear();
+        count = 0;
+    }
+
+    size_t Size() const { return count; }
+};
+
+#endif
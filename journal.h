@@ -0,0 +1,340 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "pipe_manager.h"
+#include "compress_manager.h"
+#include "snapshot.h"
+#include "mapped_file.h"
+#include "atomic_file.h"
+#include "record_codec.h"
+#include "logger.h"
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// Write-ahead journal of every change to the pipe and station managers.
+// Each Add, Update (the edit screens) and Delete is appended as one small
+// record as it happens; once the journal grows past checkpointBytes the
+// whole data set is written to a snapshot (snapshot.h) and the journal
+// starts over. On startup Open() loads the checkpoint and replays the
+// journal on top of it.
+//
+// Journal file: JOURNAL_MAGIC, then records
+//
+//   u32 size       whole record, including this field and the checksum
+//   u8  op         JournalOp
+//   payload        a full record (record_codec.h) for puts, an id for deletes
+//   u64 checksum   SnapshotChecksum of op and payload
+//
+// Replay stops at the first short or damaged record (a write cut off by a
+// crash) and the journal is truncated there. Every op is idempotent:
+// puts store the record under its id and deletes ignore missing ids. So
+// a crash between writing a checkpoint and resetting the journal only
+// replays changes the checkpoint already holds.
+
+static const char JOURNAL_MAGIC[8] = {'P', 'I', 'P', 'E', 'W', 'A', 'L', '\n'};
+
+enum class JournalOp : uint8_t { PutPipe = 1, DeletePipe, PutCs, DeleteCs };
+
+struct JournalPolicy {
+    uint64_t checkpointBytes = 4ull << 20;  // checkpoint once the journal is this large
+};
+
+class Journal : public ManagerListener<Pipe>, public ManagerListener<Compress> {
+private:
+    static constexpr size_t RECORD_OVERHEAD = 4 + 1 + 8;
+
+    PipeManager& pipes;
+    CompressManager& stations;
+    Logger& logger;
+    string journalPath;
+    string checkpointPath;
+    JournalPolicy policy;
+
+    ofstream file;
+    uint64_t journalBytes = 0;
+    string buffer;
+    int pauseDepth = 0;
+    bool changedWhilePaused = false;
+    bool attached = false;
+    bool checkpointDue = false;
+    uint64_t retryAt = 0;           // after a failed checkpoint, don't try again before this size
+
+    void Begin(JournalOp op) {
+        buffer.clear();
+        PutValue(buffer, uint32_t(0));
+        PutValue(buffer, static_cast<uint8_t>(op));
+    }
+
+    // Finishes the record in buffer and appends it. Listeners hear of an
+    // update or delete before the manager applies it, so a checkpoint
+    // taken here would miss the change and then truncate its record away;
+    // a full journal is checkpointed at the start of the next append
+    // instead, when the previous change is in place.
+    void Append() {
+        if (pauseDepth > 0) {
+            changedWhilePaused = true;
+            return;
+        }
+        if (!attached) return;
+        if (checkpointDue) Checkpoint();
+        uint64_t checksum = SnapshotChecksum(buffer.data() + 4, buffer.size() - 4);
+        PutValue(buffer, checksum);
+        uint32_t size = static_cast<uint32_t>(buffer.size());
+        memcpy(&buffer[0], &size, 4);
+
+        file.write(buffer.data(), streamsize(buffer.size()));
+        file.flush();
+        journalBytes += buffer.size();
+        if (journalBytes >= max(policy.checkpointBytes, retryAt)) checkpointDue = true;
+    }
+
+    // Applies one record; false if its payload doesn't decode.
+    bool Apply(JournalOp op, const char* p, const char* end) {
+        int32_t id;
+        switch (op) {
+        case JournalOp::PutPipe: {
+            Pipe pipe;
+            if (!DecodeRecord(p, end, pipe)) return false;
+            pipes.Insert(pipe);
+            return true;
+        }
+        case JournalOp::PutCs: {
+            Compress station;
+            if (!DecodeRecord(p, end, station)) return false;
+            stations.Insert(station);
+            return true;
+        }
+        case JournalOp::DeletePipe:
+            if (!GetValue(p, end, id)) return false;
+            pipes.Delete(id);
+            return true;
+        case JournalOp::DeleteCs:
+            if (!GetValue(p, end, id)) return false;
+            stations.Delete(id);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Replays the journal and returns the number of records applied.
+    // Anything after the last intact record is cut off.
+    size_t Replay() {
+        size_t applied = 0;
+        uint64_t good = 0;
+        {
+            MappedFile journal;
+            if (!journal.Open(journalPath) || journal.Size() < sizeof(JOURNAL_MAGIC) ||
+                memcmp(journal.Data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+                return 0;
+            }
+            const char* p = journal.Data() + sizeof(JOURNAL_MAGIC);
+            const char* end = journal.End();
+            while (size_t(end - p) >= RECORD_OVERHEAD) {
+                uint32_t size;
+                memcpy(&size, p, 4);
+                if (size < RECORD_OVERHEAD || size > size_t(end - p)) break;
+                uint64_t checksum;
+                memcpy(&checksum, p + size - 8, 8);
+                if (checksum != SnapshotChecksum(p + 4, size - 4 - 8)) break;
+                if (!Apply(static_cast<JournalOp>(p[4]), p + 5, p + size - 8)) break;
+                applied++;
+                p += size;
+            }
+            good = uint64_t(p - journal.Data());
+            if (p != end) {
+                cout << "Warning: journal " << journalPath << " is damaged after record " << applied
+                     << "; the rest was discarded.\n";
+                logger.Log(LogLevel::Warning, LogCategory::Storage, "WARNING: Journal damaged after record " +
+                           to_string(applied) + " - " + to_string(uint64_t(end - p)) + " bytes discarded");
+            }
+        }
+        error_code ec;
+        if (good < filesystem::file_size(journalPath, ec) && !ec) filesystem::resize_file(journalPath, good, ec);
+        journalBytes = good;
+        return applied;
+    }
+
+    // Appends to the journal left by Replay, or starts a new one.
+    void OpenJournal(bool truncate) {
+        bool fresh = truncate || journalBytes == 0;
+        file.close();
+        file.open(journalPath, ios::binary | (fresh ? ios::trunc : ios::app));
+        if (fresh) {
+            file.write(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+            file.flush();
+            journalBytes = sizeof(JOURNAL_MAGIC);
+        }
+        if (!file.is_open()) {
+            cout << "Warning: Could not open journal " << journalPath << "; changes will not be journaled.\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Could not open journal " + journalPath);
+        }
+    }
+
+public:
+    Journal(PipeManager& pipeManager, CompressManager& compressManager, Logger& log,
+            const string& baseName = "data_journal", const JournalPolicy& journalPolicy = JournalPolicy())
+        : pipes(pipeManager), stations(compressManager), logger(log),
+          journalPath(baseName + ".wal"), checkpointPath(baseName + ".checkpoint.bin"), policy(journalPolicy) {}
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        if (!attached) return;
+        pipes.Unsubscribe(this);
+        stations.Unsubscribe(this);
+    }
+
+    // Restores the managers from the checkpoint and the journal, then
+    // starts journaling. The managers should be empty. Returns false if
+    // there was nothing to recover.
+    bool Open() {
+        bool recovered = false;
+        size_t replayed = 0;
+        SnapshotReader checkpoint;
+        if (filesystem::exists(checkpointPath)) {
+            if (checkpoint.Open(checkpointPath)) {
+                vector<Pipe> savedPipes(checkpoint.PipeCount());
+                for (size_t i = 0; i < savedPipes.size(); i++) savedPipes[i] = checkpoint.PipeAt(i);
+                vector<Compress> savedStations(checkpoint.StationCount());
+                for (size_t i = 0; i < savedStations.size(); i++) savedStations[i] = checkpoint.StationAt(i);
+                pipes.AddRange(move(savedPipes));
+                stations.AddRange(move(savedStations));
+                recovered = true;
+            } else {
+                cout << "Warning: checkpoint " << checkpointPath << " is unreadable (" << checkpoint.Error() << ").\n";
+                logger.Log(LogLevel::Error, LogCategory::Storage,
+                           "ERROR: Unreadable checkpoint " + checkpointPath + " - " + checkpoint.Error());
+            }
+        }
+        replayed = Replay();
+        recovered = recovered || replayed > 0;
+
+        // Subscribing replays the current records to us; don't journal them.
+        pauseDepth++;
+        pipes.Subscribe(this);
+        stations.Subscribe(this);
+        pauseDepth--;
+        changedWhilePaused = false;
+        attached = true;
+        OpenJournal(false);
+
+        if (recovered) {
+            cout << "Recovered " << pipes.Size() << " pipes and " << stations.Size() << " CS ("
+                 << replayed << " journal records replayed).\n";
+            logger.Log(LogLevel::Info, LogCategory::Storage, "RECOVERED DATA - Pipes: " + to_string(pipes.Size()) +
+                       ", CS: " + to_string(stations.Size()) + ", journal records: " + to_string(replayed));
+        }
+        return recovered;
+    }
+
+    // Writes the current data to the checkpoint and empties the journal.
+    // The checkpoint replaces the old one atomically (atomic_file.h). If
+    // it fails the journal is kept and the next attempt waits until
+    // another checkpointBytes have been appended. Nothing is written once
+    // paged storage has failed: the journal still holds the changes.
+    bool Checkpoint() {
+        if (!attached) return false;
+        checkpointDue = false;
+        if (pipes.StorageFailed() || stations.StorageFailed()) {
+            cout << "Warning: Checkpoint skipped: the paged data file has read or write errors.\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage,
+                       "ERROR: Checkpoint skipped - paged storage I/O error, journal kept");
+            retryAt = journalBytes + policy.checkpointBytes;
+            return false;
+        }
+        string temp = TempPathFor(checkpointPath);
+        vector<Pipe> pipeCopy;
+        vector<Compress> stationCopy;
+        if (!WriteSnapshot(temp, pipes.Records(pipeCopy), stations.Records(stationCopy)) ||
+            !ReplaceFile(temp, checkpointPath)) {
+            remove(temp.c_str());
+            cout << "Warning: Could not write checkpoint " << checkpointPath << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::Storage, "ERROR: Could not write checkpoint " + checkpointPath);
+            retryAt = journalBytes + policy.checkpointBytes;
+            return false;
+        }
+        OpenJournal(true);
+        changedWhilePaused = false;
+        retryAt = 0;
+        return true;
+    }
+
+    // While paused, changes are not journaled; the last Resume takes a
+    // checkpoint if anything changed. Used around bulk loads, which
+    // would otherwise journal every record.
+    void Pause() { pauseDepth++; }
+
+    void Resume() {
+        if (pauseDepth > 0 && --pauseDepth == 0 && changedWhilePaused) Checkpoint();
+    }
+
+    void SetPolicy(const JournalPolicy& p) { policy = p; }
+    uint64_t JournalBytes() const { return journalBytes; }
+    const string& JournalPath() const { return journalPath; }
+    const string& CheckpointPath() const { return checkpointPath; }
+
+    void OnInserted(const Pipe& pipe, size_t) override { PutPipe(pipe); }
+    void OnInsertedRange(const Pipe*, size_t, size_t) override { Captured(); }
+    void OnUpdated(const Pipe&, const Pipe& after, size_t) override { PutPipe(after); }
+
+    void OnErased(const Pipe& pipe, size_t, size_t) override {
+        Begin(JournalOp::DeletePipe);
+        PutValue(buffer, static_cast<int32_t>(pipe.id));
+        Append();
+    }
+
+    void OnInserted(const Compress& station, size_t) override { PutStation(station); }
+    void OnInsertedRange(const Compress*, size_t, size_t) override { Captured(); }
+    void OnUpdated(const Compress&, const Compress& after, size_t) override { PutStation(after); }
+
+    void OnErased(const Compress& station, size_t, size_t) override {
+        Begin(JournalOp::DeleteCs);
+        PutValue(buffer, static_cast<int32_t>(station.id));
+        Append();
+    }
+
+    // Shared by both managers. Clears and bulk inserts aren't journaled;
+    // the state after one is captured by a checkpoint instead.
+    void OnCleared() override { Captured(); }
+
+private:
+    void Captured() {
+        if (pauseDepth > 0) changedWhilePaused = true;
+        else Checkpoint();
+    }
+
+    void PutPipe(const Pipe& pipe) {
+        Begin(JournalOp::PutPipe);
+        EncodeRecord(buffer, pipe);
+        Append();
+    }
+
+    void PutStation(const Compress& station) {
+        Begin(JournalOp::PutCs);
+        EncodeRecord(buffer, station);
+        Append();
+    }
+};
+
+// Pauses a journal for the lifetime of the guard.
+class JournalPause {
+private:
+    Journal& journal;
+
+public:
+    explicit JournalPause(Journal& j) : journal(j) { journal.Pause(); }
+    ~JournalPause() { journal.Resume(); }
+
+    JournalPause(const JournalPause&) = delete;
+    JournalPause& operator=(const JournalPause&) = delete;
+};
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef LOG_RECORD_H
+#define LOG_RECORD_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <cstdio>
+#include <chrono>
+
+using namespace std;
+
+// Binary operation log. The file starts with LOG_MAGIC, followed by
+// records:
+//
+//   u32 size         whole record, including this field
+//   u16 event        LogEvent code
+//   u8  argc
+//   i64 timestamp    nanoseconds since the Unix epoch
+//   argc x (u8 type, payload)
+//
+// Int payloads are zigzag varints, Double is 8 raw bytes, Bool is one
+// byte and String is a varint length followed by the bytes. Writers only
+// copy raw values; the text shown to users is produced by FormatRecord
+// when the log is read.
+
+static const char LOG_MAGIC[8] = {'O', 'P', 'L', 'O', 'G', 'B', '1', '\n'};
+static constexpr size_t LOG_RECORD_HEADER = 4 + 2 + 1 + 8;
+
+enum class LogEvent : uint16_t {
+    Text = 0,
+    AppStarted,
+    AppClosed,
+    AddedPipe,
+    DeletedPipe,
+    AddedCs,
+    DeletedCs,
+    ViewedAllPipes,
+    ViewedAllCs,
+    SearchResult,
+    SavedAllData,
+    LoadedAllData,
+    AddedPipeRange,
+    AddedCsRange,
+    ImportedCsv,
+    ExportedCsv,
+    Count
+};
+
+// Message template per event; {n} is replaced by argument n. Doubles are
+// printed with two decimals and bools as Yes/No, as the text log did.
+inline const char* LogEventFormat(LogEvent event) {
+    switch (event) {
+    case LogEvent::Text: return "{0}";
+    case LogEvent::AppStarted: return "APPLICATION STARTED";
+    case LogEvent::AppClosed: return "APPLICATION CLOSED";
+    case LogEvent::AddedPipe: return "ADDED PIPE - ID: {0}, KM Mark: {1}, Length: {2} km, Diameter: {3} mm, On repair: {4}";
+    case LogEvent::DeletedPipe: return "DELETED PIPE - ID: {0}, KM Mark: {1}, Length: {2} km, Diameter: {3} mm";
+    case LogEvent::AddedCs: return "ADDED CS - ID: {0}, Name: {1}, Workshops: {2}, Working: {3}, Class: {4}, Active: {5}";
+    case LogEvent::DeletedCs: return "DELETED CS - ID: {0}, Name: {1}, Workshops: {2}, Working: {3}";
+    case LogEvent::ViewedAllPipes: return "VIEWED ALL PIPES - Total: {0}";
+    case LogEvent::ViewedAllCs: return "VIEWED ALL CS - Total: {0}";
+    case LogEvent::SearchResult: return "{0} - Found: {1}";
+    case LogEvent::SavedAllData: return "SAVED ALL DATA - Pipes: {0}, CS: {1} exported to {2}";
+    case LogEvent::LoadedAllData: return "LOADED ALL DATA - Pipes: {0}, CS: {1} imported from {2}";
+    case LogEvent::AddedPipeRange: return "ADDED PIPES - Count: {0}, Total: {1}";
+    case LogEvent::AddedCsRange: return "ADDED CS - Count: {0}, Total: {1}";
+    case LogEvent::ImportedCsv: return "IMPORTED CSV - {0}: {1} added, {2} replaced, {3} skipped from {4}";
+    case LogEvent::ExportedCsv: return "EXPORTED CSV - {0}: {1} exported to {2}";
+    default: return "UNKNOWN EVENT";
+    }
+}
+
+// Severity, lowest first. Entries below the logger's level are dropped
+// before anything is encoded.
+enum class LogLevel : uint8_t { Debug = 0, Info, Warning, Error, Off };
+
+enum class LogCategory : uint8_t { General = 0, Pipes, Stations, Search, View, Storage, Count };
+
+inline const char* LogLevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warning: return "WARNING";
+    case LogLevel::Error: return "ERROR";
+    default: return "OFF";
+    }
+}
+
+inline const char* LogCategoryName(LogCategory category) {
+    switch (category) {
+    case LogCategory::General: return "GENERAL";
+    case LogCategory::Pipes: return "PIPES";
+    case LogCategory::Stations: return "STATIONS";
+    case LogCategory::Search: return "SEARCH";
+    case LogCategory::View: return "VIEW";
+    case LogCategory::Storage: return "STORAGE";
+    default: return "UNKNOWN";
+    }
+}
+
+// Read-only operations (viewing lists, searches) are Debug so they can be
+// switched off without losing changes to the data.
+constexpr LogLevel LogEventLevel(LogEvent event) {
+    switch (event) {
+    case LogEvent::ViewedAllPipes:
+    case LogEvent::ViewedAllCs:
+    case LogEvent::SearchResult:
+        return LogLevel::Debug;
+    default:
+        return LogLevel::Info;
+    }
+}
+
+constexpr LogCategory LogEventCategory(LogEvent event) {
+    switch (event) {
+    case LogEvent::AddedPipe:
+    case LogEvent::AddedPipeRange:
+    case LogEvent::DeletedPipe:
+        return LogCategory::Pipes;
+    case LogEvent::AddedCs:
+    case LogEvent::AddedCsRange:
+    case LogEvent::DeletedCs:
+        return LogCategory::Stations;
+    case LogEvent::ViewedAllPipes:
+    case LogEvent::ViewedAllCs:
+        return LogCategory::View;
+    case LogEvent::SearchResult:
+        return LogCategory::Search;
+    case LogEvent::SavedAllData:
+    case LogEvent::LoadedAllData:
+    case LogEvent::ImportedCsv:
+    case LogEvent::ExportedCsv:
+        return LogCategory::Storage;
+    default:
+        return LogCategory::General;
+    }
+}
+
+enum class LogArgType : uint8_t { Int = 1, Double, Bool, String };
+
+struct LogArg {
+    LogArgType type = LogArgType::Int;
+    int64_t i = 0;
+    double d = 0;
+    const char* text = nullptr;  // points into the record buffer
+    size_t length = 0;
+};
+
+struct LogRecord {
+    LogEvent event = LogEvent::Text;
+    int64_t timestamp = 0;
+    vector<LogArg> args;
+};
+
+inline int64_t LogNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Appends one record to a byte buffer.
+class LogRecordWriter {
+private:
+    string& out;
+    size_t start;
+
+    void PutVarint(uint64_t v) {
+        while (v >= 0x80) {
+            out += char(v | 0x80);
+            v >>= 7;
+        }
+        out += char(v);
+    }
+
+    void PutRaw(const void* p, size_t n) { out.append(static_cast<const char*>(p), n); }
+
+    void PutInt(int64_t v) {
+        out += char(LogArgType::Int);
+        PutVarint((uint64_t(v) << 1) ^ uint64_t(v >> 63));
+    }
+
+    void Put(bool v) {
+        out += char(LogArgType::Bool);
+        out += char(v ? 1 : 0);
+    }
+    void Put(int v) { PutInt(v); }
+    void Put(long v) { PutInt(v); }
+    void Put(long long v) { PutInt(v); }
+    void Put(unsigned v) { PutInt(int64_t(v)); }
+    void Put(unsigned long v) { PutInt(int64_t(v)); }
+    void Put(unsigned long long v) { PutInt(int64_t(v)); }
+    void Put(double v) {
+        out += char(LogArgType::Double);
+        PutRaw(&v, sizeof(v));
+    }
+    void Put(const char* v) { PutText(v, strlen(v)); }
+    void Put(const string& v) { PutText(v.data(), v.size()); }
+
+    void PutText(const char* p, size_t n) {
+        out += char(LogArgType::String);
+        PutVarint(n);
+        PutRaw(p, n);
+    }
+
+public:
+    template<typename... Args>
+    LogRecordWriter(string& buffer, LogEvent event, int64_t timestamp, const Args&... args)
+        : out(buffer), start(buffer.size()) {
+        uint32_t size = 0;
+        uint16_t code = uint16_t(event);
+        uint8_t argc = uint8_t(sizeof...(Args));
+        PutRaw(&size, sizeof(size));
+        PutRaw(&code, sizeof(code));
+        PutRaw(&argc, sizeof(argc));
+        PutRaw(&timestamp, sizeof(timestamp));
+        (Put(args), ...);
+        size = uint32_t(out.size() - start);
+        memcpy(&out[start], &size, sizeof(size));
+    }
+};
+
+inline bool GetVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = uint8_t(*p++);
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Decodes the record at p; returns its size, or 0 if the bytes are
+// truncated or malformed. String args point into [p, end).
+inline size_t DecodeRecord(const char* p, const char* end, LogRecord& record) {
+    if (size_t(end - p) < LOG_RECORD_HEADER) return 0;
+    uint32_t size;
+    uint16_t code;
+    uint8_t argc;
+    memcpy(&size, p, 4);
+    memcpy(&code, p + 4, 2);
+    memcpy(&argc, p + 6, 1);
+    memcpy(&record.timestamp, p + 7, 8);
+    if (size < LOG_RECORD_HEADER || size > size_t(end - p)) return 0;
+    record.event = LogEvent(code);
+
+    const char* q = p + LOG_RECORD_HEADER;
+    const char* recordEnd = p + size;
+    record.args.resize(argc);
+    for (auto& arg : record.args) {
+        if (q >= recordEnd) return 0;
+        arg.type = LogArgType(*q++);
+        uint64_t v;
+        switch (arg.type) {
+        case LogArgType::Int:
+            if (!GetVarint(q, recordEnd, v)) return 0;
+            arg.i = int64_t(v >> 1) ^ -int64_t(v & 1);
+            break;
+        case LogArgType::Double:
+            if (recordEnd - q < 8) return 0;
+            memcpy(&arg.d, q, 8);
+            q += 8;
+            break;
+        case LogArgType::Bool:
+            if (q >= recordEnd) return 0;
+            arg.i = *q++ != 0;
+            break;
+        case LogArgType::String:
+            if (!GetVarint(q, recordEnd, v) || v > uint64_t(recordEnd - q)) return 0;
+            arg.text = q;
+            arg.length = size_t(v);
+            q += v;
+            break;
+        default:
+            return 0;
+        }
+    }
+    return size;
+}
+
+inline string FormatLogTime(int64_t timestamp) {
+    time_t t = time_t(timestamp / 1000000000);
+    struct tm timeinfo;
+#ifdef _WIN32
+    localtime_s(&timeinfo, &t);
+#else
+    localtime_r(&t, &timeinfo);
+#endif
+    char buffer[80];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    return string(buffer);
+}
+
+inline void AppendLogArg(string& out, const LogArg& arg) {
+    char buffer[64];
+    switch (arg.type) {
+    case LogArgType::Int: out += to_string(arg.i); break;
+    case LogArgType::Double:
+        snprintf(buffer, sizeof(buffer), "%.2f", arg.d);
+        out += buffer;
+        break;
+    case LogArgType::Bool: out += arg.i ? "Yes" : "No"; break;
+    case LogArgType::String: out.append(arg.text, arg.length); break;
+    }
+}
+
+// The message text, without the timestamp.
+inline string FormatLogMessage(const LogRecord& record) {
+    string out;
+    for (const char* f = LogEventFormat(record.event); *f; f++) {
+        if (f[0] == '{' && f[1] >= '0' && f[1] <= '9' && f[2] == '}') {
+            size_t n = size_t(f[1] - '0');
+            if (n < record.args.size()) AppendLogArg(out, record.args[n]);
+            f += 2;
+        } else {
+            out += *f;
+        }
+    }
+    return out;
+}
+
+// One line in the format of the old text log.
+inline string FormatRecord(const LogRecord& record) {
+    return "[" + FormatLogTime(record.timestamp) + "] " + FormatLogMessage(record);
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef LOG_SEGMENTS_H
+#define LOG_SEGMENTS_H
+
+#include "lz_codec.h"
+#include "mapped_file.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+
+using namespace std;
+
+// The operation log is a series of segments next to the base name:
+//
+//   operations_log.000001.bin.lz   sealed, compressed
+//   operations_log.000002.bin      sealed, waiting for compression
+//   operations_log.000003.bin      active, being appended to
+//
+// A single operations_log.bin from before segmenting is read as
+// segment 0. Each segment is a complete binary log (LOG_MAGIC followed
+// by whole records), so readers never see a record split across files.
+
+struct LogRetention {
+    uint64_t segmentBytes = 8ull << 20;     // seal the active segment past this size
+    uint64_t maxTotalBytes = 512ull << 20;  // drop oldest segments beyond this; 0 = no limit
+    int maxAgeDays = 30;                    // drop segments not written for this long; 0 = no limit
+    bool compress = true;                   // compress sealed segments in the background
+};
+
+struct LogSegmentFile {
+    uint64_t sequence = 0;
+    string path;
+    bool compressed = false;
+    uintmax_t bytes = 0;
+};
+
+static const char LOG_SEGMENT_MAGIC[8] = {'O', 'P', 'L', 'O', 'G', 'Z', '1', '\n'};
+static constexpr size_t LOG_SEGMENT_HEADER = 8 + 8 + 8;  // magic, raw size, raw hash
+
+inline string LogSegmentPath(const string& base, uint64_t sequence) {
+    if (sequence == 0) return base + ".bin";
+    char number[32];
+    snprintf(number, sizeof(number), ".%06llu.bin", static_cast<unsigned long long>(sequence));
+    return base + number;
+}
+
+inline string LogSegmentIndexPath(const string& base, uint64_t sequence) {
+    return LogSegmentPath(base, sequence) + ".idx";
+}
+
+// Segments for base, oldest first. If a segment exists both raw and
+// compressed (compression finished but the raw file is not removed yet),
+// the raw file is listed.
+inline vector<LogSegmentFile> ListLogSegments(const string& base) {
+    namespace fs = std::filesystem;
+    vector<LogSegmentFile> segments;
+    fs::path basePath(base);
+    fs::path dir = basePath.has_parent_path() ? basePath.parent_path() : fs::path(".");
+    string stem = basePath.filename().string();
+
+    error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename().string();
+        if (name.compare(0, stem.size() + 1, stem + ".") != 0) continue;
+        string rest = name.substr(stem.size() + 1);
+
+        LogSegmentFile segment;
+        segment.path = (dir / name).string();
+        if (rest == "bin" || rest == "bin.lz") {
+            segment.sequence = 0;
+            segment.compressed = rest == "bin.lz";
+        } else {
+            size_t digits = 0;
+            while (digits < rest.size() && isdigit(static_cast<unsigned char>(rest[digits]))) digits++;
+            string suffix = rest.substr(digits);
+            if (digits == 0 || (suffix != ".bin" && suffix != ".bin.lz")) continue;
+            segment.sequence = stoull(rest.substr(0, digits));
+            segment.compressed = suffix == ".bin.lz";
+            if (segment.sequence == 0) continue;
+        }
+        segment.bytes = fs::file_size(it->path(), ec);
+        if (ec) {
+            ec.clear();
+            continue;
+        }
+        segments.push_back(segment);
+    }
+
+    sort(segments.begin(), segments.end(), [](const LogSegmentFile& a, const LogSegmentFile& b) {
+        return a.sequence != b.sequence ? a.sequence < b.sequence : !a.compressed && b.compressed;
+    });
+    segments.erase(unique(segments.begin(), segments.end(),
+        [](const LogSegmentFile& a, const LogSegmentFile& b) { return a.sequence == b.sequence; }), segments.end());
+    return segments;
+}
+
+inline uint64_t HashBytes(const char* p, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= uint8_t(p[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Writes rawPath compressed to rawPath + ".lz" via a temporary file and
+// removes the raw file. Returns false and leaves the raw file alone if
+// anything fails.
+inline bool CompressLogSegment(const string& rawPath) {
+    MappedFile raw;
+    if (!raw.Open(rawPath)) return false;
+    string packed = lz::Compress(raw.Data(), raw.Size());
+    uint64_t rawSize = raw.Size();
+    uint64_t hash = HashBytes(raw.Data(), raw.Size());
+    raw.Close();
+
+    string target = rawPath + ".lz";
+    string temp = target + ".tmp";
+    {
+        ofstream out(temp, ios::binary | ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(LOG_SEGMENT_MAGIC, sizeof(LOG_SEGMENT_MAGIC));
+        out.write(reinterpret_cast<const char*>(&rawSize), 8);
+        out.write(reinterpret_cast<const char*>(&hash), 8);
+        out.write(packed.data(), streamsize(packed.size()));
+        if (!out) {
+            out.close();
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    error_code ec;
+    std::filesystem::rename(temp, target, ec);
+    if (ec) {
+        remove(temp.c_str());
+        return false;
+    }
+    remove(rawPath.c_str());
+    return true;
+}
+
+// Raw size recorded in a compressed segment header, or 0 if unreadable.
+inline uint64_t CompressedLogSegmentSize(const string& path) {
+    ifstream in(path, ios::binary);
+    char header[LOG_SEGMENT_HEADER];
+    if (!in.read(header, sizeof(header)) || memcmp(header, LOG_SEGMENT_MAGIC, 8) != 0) return 0;
+    uint64_t rawSize;
+    memcpy(&rawSize, header + 8, 8);
+    return rawSize;
+}
+
+inline bool ReadCompressedLogSegment(const string& path, string& raw) {
+    MappedFile file;
+    if (!file.Open(path) || file.Size() < LOG_SEGMENT_HEADER) return false;
+    if (memcmp(file.Data(), LOG_SEGMENT_MAGIC, 8) != 0) return false;
+    uint64_t rawSize, hash;
+    memcpy(&rawSize, file.Data() + 8, 8);
+    memcpy(&hash, file.Data() + 16, 8);
+    // A compressed byte expands to at most 255, so a larger raw size is a
+    // corrupt header and must not size the output buffer.
+    size_t packedSize = file.Size() - LOG_SEGMENT_HEADER;
+    if (rawSize / 256 > packedSize + 1) return false;
+    return lz::Decompress(file.Data() + LOG_SEGMENT_HEADER, packedSize, size_t(rawSize), raw)
+        && HashBytes(raw.data(), raw.size()) == hash;
+}
+
+#endif
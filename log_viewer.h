@@ -0,0 +1,376 @@
+#ifndef LOG_VIEWER_H
+#define LOG_VIEWER_H
+
+#include "log_record.h"
+#include "log_segments.h"
+#include "mapped_file.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+// Which records to show. Times are nanoseconds since the epoch; type is
+// a prefix of the message text ("ADDED PIPE", "SEARCH", "ERROR", ...).
+struct LogFilter {
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    string type;
+
+    bool Matches(const LogRecord& record) const {
+        if (record.timestamp < from || record.timestamp > to) return false;
+        if (type.empty()) return true;
+
+        // Text and search events start with their first argument; the
+        // others with the literal head of their template.
+        if ((record.event == LogEvent::Text || record.event == LogEvent::SearchResult)
+            && !record.args.empty() && record.args[0].type == LogArgType::String) {
+            const LogArg& head = record.args[0];
+            if (type.size() <= head.length) return type.compare(0, type.size(), head.text, type.size()) == 0;
+        } else {
+            const char* format = LogEventFormat(record.event);
+            size_t literal = strcspn(format, "{");
+            if (type.size() <= literal) return type.compare(0, type.size(), format, type.size()) == 0;
+        }
+        return FormatLogMessage(record).compare(0, type.size(), type) == 0;
+    }
+};
+
+// One log segment with a sparse index: one entry per INDEX_STRIDE
+// records. The index is cached next to the segment (<segment>.idx) and
+// extended incrementally, since segments are append-only. Compressed
+// segments are only decompressed when their records are read.
+class LogSegmentReader {
+public:
+    struct IndexEntry {
+        uint64_t offset;     // of record number k * INDEX_STRIDE
+        int64_t timestamp;   // of that record
+        int64_t maxBefore;   // latest timestamp among earlier records
+    };
+
+    static constexpr uint64_t INDEX_STRIDE = 1024;
+
+private:
+    static constexpr char INDEX_MAGIC[8] = {'O', 'P', 'L', 'O', 'G', 'I', 'X', '1'};
+
+    LogSegmentFile segment;
+    string indexPath;
+    MappedFile file;
+    string unpacked;
+    bool loaded = false;
+
+    vector<IndexEntry> index;
+    uint64_t indexedEnd = 0;
+    uint64_t recordCount = 0;
+    int64_t maxTimestamp = INT64_MIN;
+
+    bool LoadIndex() {
+        ifstream in(indexPath, ios::binary);
+        if (!in.is_open()) return false;
+        char magic[8];
+        uint64_t stride, entries;
+        in.read(magic, 8);
+        in.read(reinterpret_cast<char*>(&stride), 8);
+        in.read(reinterpret_cast<char*>(&indexedEnd), 8);
+        in.read(reinterpret_cast<char*>(&recordCount), 8);
+        in.read(reinterpret_cast<char*>(&maxTimestamp), 8);
+        in.read(reinterpret_cast<char*>(&entries), 8);
+        if (!in || memcmp(magic, INDEX_MAGIC, 8) != 0 || stride != INDEX_STRIDE) return false;
+        if (entries != (recordCount + INDEX_STRIDE - 1) / INDEX_STRIDE) return false;
+        // The entries must fit in the rest of the file before they are
+        // allocated.
+        streamoff header = in.tellg();
+        in.seekg(0, ios::end);
+        uint64_t available = uint64_t(in.tellg() - header);
+        in.seekg(header);
+        if (!in || entries > available / sizeof(IndexEntry)) return false;
+        index.resize(entries);
+        in.read(reinterpret_cast<char*>(index.data()), streamsize(entries * sizeof(IndexEntry)));
+        return bool(in);
+    }
+
+    void SaveIndex() const {
+        ofstream out(indexPath, ios::binary | ios::trunc);
+        if (!out.is_open()) return;
+        uint64_t stride = INDEX_STRIDE, entries = index.size();
+        out.write(INDEX_MAGIC, 8);
+        out.write(reinterpret_cast<const char*>(&stride), 8);
+        out.write(reinterpret_cast<const char*>(&indexedEnd), 8);
+        out.write(reinterpret_cast<const char*>(&recordCount), 8);
+        out.write(reinterpret_cast<const char*>(&maxTimestamp), 8);
+        out.write(reinterpret_cast<const char*>(&entries), 8);
+        out.write(reinterpret_cast<const char*>(index.data()), streamsize(entries * sizeof(IndexEntry)));
+    }
+
+    // A cached index is reused only if the segment still holds the
+    // records it describes: long enough, and the last indexed record
+    // unchanged. Compressed segments are sealed, so a matching size is
+    // enough and the data need not be unpacked.
+    bool IndexMatchesSegment() {
+        if (segment.compressed) return indexedEnd == CompressedLogSegmentSize(segment.path);
+        if (!LoadData()) return false;
+        if (indexedEnd < sizeof(LOG_MAGIC) || indexedEnd > Size()) return false;
+        if (index.empty()) return indexedEnd == sizeof(LOG_MAGIC);
+        const IndexEntry& last = index.back();
+        LogRecord record;
+        return last.offset < indexedEnd
+            && DecodeRecord(Data() + last.offset, Data() + Size(), record) > 0
+            && record.timestamp == last.timestamp;
+    }
+
+    void ResetIndex() {
+        index.clear();
+        indexedEnd = sizeof(LOG_MAGIC);
+        recordCount = 0;
+        maxTimestamp = INT64_MIN;
+    }
+
+    // Indexes records appended since the last run. A record cut short by
+    // a concurrent write ends the scan; it is picked up next time.
+    bool ExtendIndex() {
+        if (segment.compressed && indexedEnd == CompressedLogSegmentSize(segment.path)) return false;
+        if (!LoadData()) return false;
+        LogRecord record;
+        bool changed = false;
+        const char* p = Data() + indexedEnd;
+        const char* end = Data() + Size();
+        while (p < end) {
+            size_t size = DecodeRecord(p, end, record);
+            if (size == 0) break;
+            if (recordCount % INDEX_STRIDE == 0) {
+                index.push_back({uint64_t(p - Data()), record.timestamp, maxTimestamp});
+            }
+            maxTimestamp = max(maxTimestamp, record.timestamp);
+            recordCount++;
+            p += size;
+            changed = true;
+        }
+        indexedEnd = uint64_t(p - Data());
+        return changed;
+    }
+
+public:
+    LogSegmentReader(const LogSegmentFile& s, const string& base)
+        : segment(s), indexPath(LogSegmentIndexPath(base, s.sequence)) {}
+
+    LogSegmentReader(const LogSegmentReader&) = delete;
+    LogSegmentReader& operator=(const LogSegmentReader&) = delete;
+
+    // Brings the index up to date. Returns false if the segment is not a
+    // readable binary log.
+    bool Open() {
+        bool cached = LoadIndex() && IndexMatchesSegment();
+        if (!cached) ResetIndex();
+        if (!cached && !LoadData()) return false;
+        if (ExtendIndex() || !cached) SaveIndex();
+        return true;
+    }
+
+    // Maps or unpacks the segment if that hasn't happened yet.
+    bool LoadData() {
+        if (loaded) return true;
+        bool ok = segment.compressed ? ReadCompressedLogSegment(segment.path, unpacked) : file.Open(segment.path);
+        ok = ok && Size() >= sizeof(LOG_MAGIC) && memcmp(Data(), LOG_MAGIC, sizeof(LOG_MAGIC)) == 0;
+        if (!ok) Release();
+        loaded = ok;
+        return ok;
+    }
+
+    void Release() {
+        file.Close();
+        string().swap(unpacked);
+        loaded = false;
+    }
+
+    bool Loaded() const { return loaded; }
+    bool Compressed() const { return segment.compressed; }
+    const char* Data() const { return segment.compressed ? unpacked.data() : file.Data(); }
+    size_t Size() const { return segment.compressed ? unpacked.size() : file.Size(); }
+
+    const vector<IndexEntry>& Index() const { return index; }
+    uint64_t Begin() const { return sizeof(LOG_MAGIC); }
+    uint64_t End() const { return indexedEnd; }
+    uint64_t RecordCount() const { return recordCount; }
+    int64_t MaxTimestamp() const { return maxTimestamp; }
+
+    // Offset of record number k * INDEX_STRIDE, or End() past the last block.
+    uint64_t BlockStart(size_t block) const { return block < index.size() ? index[block].offset : indexedEnd; }
+};
+
+// A place in the log: a segment and a byte offset inside it.
+struct LogPosition {
+    size_t segment = 0;
+    uint64_t offset = 0;
+
+    bool operator==(const LogPosition& other) const { return segment == other.segment && offset == other.offset; }
+    bool operator!=(const LogPosition& other) const { return !(*this == other); }
+};
+
+// Reads the segmented binary log as one sequence of records. Tail and
+// time-range lookups go through the per-segment indexes, so they only
+// decode (and, for compressed segments, unpack) what they show.
+class LogViewer {
+private:
+    // Writer threads stamp entries before queueing them, so timestamps
+    // are ordered only up to this much jitter.
+    static constexpr int64_t TIME_JITTER = 1000000000;
+    // Unpacked compressed segments kept in memory at once.
+    static constexpr size_t MAX_UNPACKED = 4;
+
+    string base;
+    vector<unique_ptr<LogSegmentReader>> segments;
+    vector<size_t> unpackedOrder;
+
+    LogSegmentReader* Segment(size_t i) {
+        LogSegmentReader& segment = *segments[i];
+        if (segment.Compressed() && !segment.Loaded()) {
+            if (!segment.LoadData()) return nullptr;
+            unpackedOrder.push_back(i);
+            if (unpackedOrder.size() > MAX_UNPACKED) {
+                segments[unpackedOrder.front()]->Release();
+                unpackedOrder.erase(unpackedOrder.begin());
+            }
+        } else if (!segment.LoadData()) {
+            return nullptr;
+        }
+        return &segment;
+    }
+
+    // Moves a position that sits at the end of a segment to the start of
+    // the next one with records.
+    LogPosition Normalize(LogPosition pos) const {
+        while (pos.segment < segments.size() && pos.offset >= segments[pos.segment]->End()) {
+            pos.segment++;
+            pos.offset = pos.segment < segments.size() ? segments[pos.segment]->Begin() : 0;
+        }
+        return pos;
+    }
+
+    bool PastRange(const LogRecord& record, const LogFilter& filter) const {
+        return filter.to != INT64_MAX && record.timestamp > filter.to + TIME_JITTER;
+    }
+
+public:
+    explicit LogViewer(const string& baseName) : base(baseName) {}
+
+    // Lists the segments and brings their indexes up to date. Returns
+    // false if there is no readable log yet.
+    bool Open() {
+        segments.clear();
+        unpackedOrder.clear();
+        for (const auto& file : ListLogSegments(base)) {
+            auto reader = make_unique<LogSegmentReader>(file, base);
+            if (!reader->Open()) continue;
+            if (reader->Compressed()) reader->Release();
+            segments.push_back(move(reader));
+        }
+        return !segments.empty();
+    }
+
+    uint64_t RecordCount() const {
+        uint64_t total = 0;
+        for (const auto& segment : segments) total += segment->RecordCount();
+        return total;
+    }
+
+    size_t SegmentCount() const { return segments.size(); }
+
+    LogPosition Begin() const { return Normalize({0, segments.empty() ? 0 : segments[0]->Begin()}); }
+    LogPosition End() const { return {segments.size(), 0}; }
+
+    // Calls f for every record, oldest first.
+    template<typename F>
+    void ForEach(F f) {
+        LogRecord record;
+        for (size_t s = 0; s < segments.size(); s++) {
+            LogSegmentReader* segment = Segment(s);
+            if (!segment) continue;
+            const char* p = segment->Data() + segment->Begin();
+            const char* end = segment->Data() + segment->End();
+            while (p < end) {
+                size_t size = DecodeRecord(p, end, record);
+                if (size == 0) break;
+                f(record);
+                p += size;
+            }
+        }
+    }
+
+    // Position of the earliest of the last n records that pass filter.
+    // Walks index blocks backwards from the end, so the cost grows with
+    // n, not with the size of the log.
+    LogPosition TailStart(size_t n, const LogFilter& filter) {
+        if (n == 0) return End();
+        LogRecord record;
+        vector<uint64_t> hits;
+        for (size_t s = segments.size(); s-- > 0;) {
+            LogSegmentReader* segment = Segment(s);
+            if (!segment) continue;
+            for (size_t block = segment->Index().size(); block-- > 0;) {
+                hits.clear();
+                const char* p = segment->Data() + segment->BlockStart(block);
+                const char* end = segment->Data() + segment->BlockStart(block + 1);
+                while (p < end) {
+                    size_t size = DecodeRecord(p, end, record);
+                    if (size == 0) break;
+                    if (filter.Matches(record)) hits.push_back(uint64_t(p - segment->Data()));
+                    p += size;
+                }
+                if (hits.size() >= n) return {s, hits[hits.size() - n]};
+                n -= hits.size();
+            }
+        }
+        return Begin();
+    }
+
+    // Position from which every record with timestamp >= from is found:
+    // the first segment that reaches from, then the last index block in
+    // it whose earlier records are all older.
+    LogPosition SeekTime(int64_t from) const {
+        for (size_t s = 0; s < segments.size(); s++) {
+            const LogSegmentReader& segment = *segments[s];
+            if (segment.MaxTimestamp() < from) continue;
+            const auto& index = segment.Index();
+            auto it = partition_point(index.begin(), index.end(),
+                [from](const LogSegmentReader::IndexEntry& e) { return e.maxBefore < from; });
+            return {s, it == index.begin() ? segment.Begin() : (it - 1)->offset};
+        }
+        return End();
+    }
+
+    // Appends up to max records passing filter, starting at pos, and
+    // returns the position to continue from (End() when done).
+    LogPosition ReadPage(LogPosition pos, const LogFilter& filter, size_t max, vector<string>& lines) {
+        LogRecord record;
+        size_t taken = 0;
+        pos = Normalize(pos);
+        while (pos.segment < segments.size()) {
+            LogSegmentReader* segment = Segment(pos.segment);
+            if (!segment) {
+                pos = Normalize({pos.segment, segments[pos.segment]->End()});
+                continue;
+            }
+            const char* p = segment->Data() + pos.offset;
+            const char* end = segment->Data() + segment->End();
+            while (p < end) {
+                size_t size = DecodeRecord(p, end, record);
+                if (size == 0 || PastRange(record, filter)) return End();
+                if (filter.Matches(record)) {
+                    // Stop in front of the first match that doesn't fit, so
+                    // the next page is known to have something to show.
+                    if (taken == max) return {pos.segment, uint64_t(p - segment->Data())};
+                    lines.push_back(FormatRecord(record));
+                    taken++;
+                }
+                p += size;
+            }
+            pos = Normalize({pos.segment, segment->End()});
+        }
+        return End();
+    }
+};
+
+#endif
@@ -1,56 +1,379 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include "bounded_queue.h"
+#include "log_record.h"
+#include "log_segments.h"
+#include "log_viewer.h"
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 using namespace std;
 
+// Levels below this generate no code at LOG_EVENT and LOG_TEXT call
+// sites: build with -DLOG_MIN_LEVEL=1 to drop Debug entries, 4 to drop
+// everything. Values follow LogLevel.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+static constexpr LogLevel LOG_COMPILED_LEVEL = static_cast<LogLevel>(LOG_MIN_LEVEL);
+
+constexpr bool LogCompiledIn(LogLevel level) { return level >= LOG_COMPILED_LEVEL; }
+
+// Logs a structured event only if its level and category are enabled.
+// The arguments are not evaluated otherwise, and generate no code if
+// the event is below LOG_MIN_LEVEL (they are still type-checked). Needs
+// at least one argument; call Log directly for events without any.
+#define LOG_EVENT(logger, event, ...)                                        \
+    do {                                                                     \
+        if constexpr (LogCompiledIn(LogEventLevel(event))) {                 \
+            if ((logger).Enabled(event)) (logger).Log(event, __VA_ARGS__);   \
+        }                                                                    \
+    } while (0)
+
+// Same for a free-form message; message is only built when enabled.
+#define LOG_TEXT(logger, level, category, message)                           \
+    do {                                                                     \
+        if constexpr (LogCompiledIn(level)) {                                \
+            if ((logger).Enabled(level, category)) (logger).Log(level, category, message); \
+        }                                                                    \
+    } while (0)
+
+// What Log does when the queue is full.
+enum class LogOverflow {
+    Block,  // wait for the writer to make room; nothing is lost
+    Drop    // discard the entry; the writer logs how many were dropped
+};
+
+// Log() encodes a binary record (see log_record.h) and pushes it onto a
+// bounded queue. A background thread drains the queue and appends each
+// batch to the active segment with a single write, keeping the file open
+// between batches, and moves to a new segment once it is full. A second
+// thread compresses sealed segments and applies the retention limits
+// (see log_segments.h). Text is only produced when the log is viewed or
+// exported.
+//
+// Every entry has a level and a category (see LogEventLevel). Entries
+// below the current level or in a disabled category return from Log
+// before anything is encoded; the LOG_EVENT and LOG_TEXT macros also
+// skip evaluating the arguments.
 class Logger {
 private:
-    string logFile;
+    using Entry = string;
 
-public:
-    Logger(const string& filename = "operations_log.txt") : logFile(filename) {}
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 8192;
+    static constexpr auto IDLE_WAIT = chrono::milliseconds(100);
+    // Age limits are checked at least this often even without rotation.
+    static constexpr auto COMPACT_INTERVAL = chrono::minutes(10);
 
-    string GetCurrentDateTime() const {
-        time_t now = time(0);
-        struct tm* timeinfo = localtime(&now);
-        char buffer[80];
-        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-        return string(buffer);
+    string baseName;
+    atomic<LogOverflow> overflow;
+    atomic<LogLevel> minLevel{LogLevel::Debug};
+    atomic<uint32_t> categoryMask{~0u};
+    BoundedQueue<Entry> queue;
+
+    atomic<uint64_t> pushed{0};
+    atomic<uint64_t> written{0};
+    atomic<uint64_t> dropped{0};
+
+    mutex wakeMutex;
+    condition_variable wake;
+    condition_variable flushed;
+    atomic<bool> idle{false};
+    atomic<bool> stopping{false};
+    thread writer;
+
+    // Owned by the writer thread, except activeSequence which the
+    // compactor reads to know which segments are sealed.
+    atomic<uint64_t> activeSequence{1};
+    uint64_t activeBytes = 0;
+
+    mutable mutex retentionMutex;
+    LogRetention retention;
+
+    mutex compactMutex;
+    condition_variable compactWake;
+    bool compactPending = false;
+    bool compactStopping = false;
+    thread compactor;
+
+    LogRetention Retention() const {
+        lock_guard<mutex> lock(retentionMutex);
+        return retention;
     }
 
-    void Log(const string& action) {
-        ofstream file(logFile, ios::app);
-        if (file.is_open()) {
-            file << "[" << GetCurrentDateTime() << "] " << action << "\n";
-            file.close();
+    void RequestCompaction() {
+        lock_guard<mutex> lock(compactMutex);
+        compactPending = true;
+        compactWake.notify_one();
+    }
+
+    // Continues the newest segment if it is raw and has room, otherwise
+    // starts a new one.
+    void ChooseActiveSegment() {
+        auto existing = ListLogSegments(baseName);
+        if (existing.empty()) return;
+        const LogSegmentFile& newest = existing.back();
+        bool reusable = newest.sequence > 0 && !newest.compressed && newest.bytes < retention.segmentBytes;
+        activeSequence = reusable ? newest.sequence : newest.sequence + 1;
+    }
+
+    void OpenActiveSegment(ofstream& file) {
+        file.open(LogSegmentPath(baseName, activeSequence), ios::app | ios::binary);
+        file.seekp(0, ios::end);
+        activeBytes = file.is_open() ? uint64_t(file.tellp()) : 0;
+        if (file.is_open() && activeBytes == 0) {
+            file.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+            activeBytes = sizeof(LOG_MAGIC);
+        }
+    }
+
+    template<typename... Args>
+    void Enqueue(LogEvent event, const Args&... args) {
+        Entry entry;
+        LogRecordWriter(entry, event, LogNow(), args...);
+        while (!queue.TryPush(entry)) {
+            if (overflow == LogOverflow::Drop) {
+                dropped++;
+                WakeWriter();
+                return;
+            }
+            WakeWriter();
+            this_thread::yield();
+        }
+        pushed++;
+        WakeWriter();
+    }
+
+    void WakeWriter() {
+        if (idle.load()) {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
         }
     }
 
-    void ViewLogs() const {
-        ifstream file(logFile);
-        if (!file.is_open()) {
-            cout << "\nNo log file found yet.\n";
-            return;
+    // Concatenates everything currently queued into one buffer and writes it.
+    size_t WriteBatch(ofstream& file, string& buffer) {
+        buffer.clear();
+        size_t count = 0;
+        Entry entry;
+        while (queue.TryPop(entry)) {
+            buffer += entry;
+            count++;
         }
 
-        cout << "\n===== Operation Logs =====\n";
-        string line;
-        int lineCount = 0;
-        while (getline(file, line)) {
-            cout << line << "\n";
-            lineCount++;
+        uint64_t lost = dropped.exchange(0);
+        if (lost > 0) {
+            LogRecordWriter(buffer, LogEvent::Text, LogNow(),
+                "WARNING: Log queue full - " + to_string(lost) + " entries dropped");
         }
-        file.close();
-        
-        if (lineCount == 0) {
-            cout << "No operations logged yet.\n";
+
+        if (!buffer.empty()) {
+            if (!file.is_open()) OpenActiveSegment(file);
+            if (file.is_open()) {
+                file.write(buffer.data(), buffer.size());
+                file.flush();
+                activeBytes += buffer.size();
+            }
+            // Seal between batches; producers keep queueing meanwhile.
+            if (activeBytes >= Retention().segmentBytes) {
+                file.close();
+                activeSequence++;
+                RequestCompaction();
+            }
         }
+        return count;
     }
+
+    void WriterLoop() {
+        ofstream file;
+        string buffer;
+        while (true) {
+            size_t count = WriteBatch(file, buffer);
+            if (count > 0) {
+                written += count;
+                lock_guard<mutex> lock(wakeMutex);
+                flushed.notify_all();
+                continue;
+            }
+            if (stopping.load() && queue.Empty()) break;
+
+            unique_lock<mutex> lock(wakeMutex);
+            idle.store(true);
+            if (queue.Empty() && !stopping.load()) wake.wait_for(lock, IDLE_WAIT);
+            idle.store(false);
+        }
+    }
+
+    // Compresses every sealed raw segment, then drops the oldest sealed
+    // segments while the log is over its size or age limit.
+    void Compact() {
+        namespace fs = std::filesystem;
+        LogRetention limits = Retention();
+        uint64_t active = activeSequence.load();
+        auto segments = ListLogSegments(baseName);
+
+        error_code ec;
+        uintmax_t total = 0;
+        for (auto& segment : segments) {
+            if (limits.compress && !segment.compressed && segment.sequence < active && CompressLogSegment(segment.path)) {
+                segment.path += ".lz";
+                segment.compressed = true;
+                segment.bytes = fs::file_size(segment.path, ec);
+                if (ec) segment.bytes = 0;
+            }
+            total += segment.bytes;
+        }
+
+        auto now = fs::file_time_type::clock::now();
+        auto maxAge = chrono::hours(24) * limits.maxAgeDays;
+        for (const auto& segment : segments) {
+            if (segment.sequence >= active) break;
+            bool tooBig = limits.maxTotalBytes > 0 && total > limits.maxTotalBytes;
+            auto modified = fs::last_write_time(segment.path, ec);
+            bool tooOld = limits.maxAgeDays > 0 && !ec && now - modified > maxAge;
+            if (!tooBig && !tooOld) break;
+            if (fs::remove(segment.path, ec)) {
+                fs::remove(LogSegmentIndexPath(baseName, segment.sequence), ec);
+                total -= segment.bytes;
+            }
+        }
+    }
+
+    void CompactorLoop() {
+        unique_lock<mutex> lock(compactMutex);
+        while (!compactStopping) {
+            compactPending = false;
+            lock.unlock();
+            Compact();
+            lock.lock();
+            compactWake.wait_for(lock, COMPACT_INTERVAL, [this] { return compactPending || compactStopping; });
+        }
+    }
+
+public:
+    // Segments are named after baseName, e.g. operations_log.000001.bin.
+    Logger(const string& baseName = "operations_log",
+           LogOverflow policy = LogOverflow::Block,
+           size_t queueCapacity = DEFAULT_QUEUE_CAPACITY,
+           const LogRetention& limits = LogRetention())
+        : baseName(baseName), overflow(policy), queue(queueCapacity), retention(limits) {
+        ChooseActiveSegment();
+        writer = thread([this] { WriterLoop(); });
+        compactor = thread([this] { CompactorLoop(); });
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    ~Logger() {
+        stopping.store(true);
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        writer.join();
+        {
+            lock_guard<mutex> lock(compactMutex);
+            compactStopping = true;
+            compactWake.notify_one();
+        }
+        compactor.join();
+    }
+
+    void SetOverflowPolicy(LogOverflow policy) { overflow = policy; }
+
+    // Takes effect from the next batch; limits are applied on the next
+    // compaction pass, which this triggers.
+    void SetRetention(const LogRetention& limits) {
+        {
+            lock_guard<mutex> lock(retentionMutex);
+            retention = limits;
+        }
+        RequestCompaction();
+    }
+
+    string GetCurrentDateTime() const {
+        return FormatLogTime(LogNow());
+    }
+
+    // Safe to call from any thread. Args may be integers, doubles, bools
+    // and strings; they are stored raw and formatted with the event's
+    // template from LogEventFormat when the log is read.
+    template<typename... Args>
+    void Log(LogEvent event, const Args&... args) {
+        if (!Enabled(event)) return;
+        Enqueue(event, args...);
+    }
+
+    // Free-form message, stored as a Text event.
+    void Log(LogLevel level, LogCategory category, const string& action) {
+        if (!Enabled(level, category)) return;
+        Enqueue(LogEvent::Text, action);
+    }
+
+    void Log(const string& action) {
+        Log(LogLevel::Info, LogCategory::General, action);
+    }
+
+    // Relaxed loads only; cheap enough to call before building a message.
+    bool Enabled(LogLevel level, LogCategory category) const {
+        return LogCompiledIn(level) && level != LogLevel::Off
+            && level >= minLevel.load(memory_order_relaxed)
+            && (categoryMask.load(memory_order_relaxed) >> static_cast<unsigned>(category) & 1u);
+    }
+
+    bool Enabled(LogEvent event) const {
+        return Enabled(LogEventLevel(event), LogEventCategory(event));
+    }
+
+    // Runtime minimum; cannot go below LOG_MIN_LEVEL.
+    void SetLevel(LogLevel level) { minLevel = level; }
+    LogLevel GetLevel() const { return minLevel; }
+
+    void SetCategoryEnabled(LogCategory category, bool enabled) {
+        uint32_t bit = 1u << static_cast<unsigned>(category);
+        if (enabled) categoryMask |= bit;
+        else categoryMask &= ~bit;
+    }
+
+    bool IsCategoryEnabled(LogCategory category) const {
+        return categoryMask >> static_cast<unsigned>(category) & 1u;
+    }
+
+    // Blocks until every entry logged before the call is on disk.
+    void Flush() {
+        uint64_t target = pushed.load();
+        unique_lock<mutex> lock(wakeMutex);
+        wake.notify_one();
+        flushed.wait(lock, [&] { return written.load() >= target; });
+    }
+
+    // Writes the log as text, one line per entry. Returns the number of
+    // entries, or -1 if the log or the output file can't be opened.
+    long long ExportText(const string& filename) {
+        Flush();
+        LogViewer viewer(baseName);
+        if (!viewer.Open()) return -1;
+        ofstream out(filename);
+        if (!out.is_open()) return -1;
+        long long count = 0;
+        viewer.ForEach([&](const LogRecord& record) {
+            out << FormatRecord(record) << "\n";
+            count++;
+        });
+        return count;
+    }
+
+    const string& BaseName() const { return baseName; }
 };
 
 #endif
@@ -0,0 +1,129 @@
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Small LZ77 block codec in the style of LZ4. A block is a series of
+// sequences:
+//
+//   token      high nibble: literal count, low nibble: match length - 4
+//   [255...]   extra literal count bytes when the nibble is 15
+//   literals
+//   u16 offset back into the output     (absent in the last sequence)
+//   [255...]   extra match length bytes when the nibble is 15
+//
+// Compression is a single greedy pass with a 64K-entry hash table; it is
+// meant to be cheap enough to run on every sealed log segment.
+namespace lz {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_BITS = 16;
+
+inline uint32_t Read32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t Hash(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+inline void PutLength(string& out, size_t n) {
+    while (n >= 255) {
+        out += char(255);
+        n -= 255;
+    }
+    out += char(n);
+}
+
+inline void PutSequence(string& out, const char* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    out += char(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalCount >= 15) PutLength(out, literalCount - 15);
+    out.append(literals, literalCount);
+    if (matchLength == 0) return;
+    out += char(offset & 0xff);
+    out += char(offset >> 8);
+    if (matchCode >= 15) PutLength(out, matchCode - 15);
+}
+
+inline string Compress(const char* in, size_t size) {
+    string out;
+    out.reserve(size / 2 + 16);
+    vector<uint32_t> table(size_t(1) << HASH_BITS, 0);  // position + 1, 0 = empty
+
+    size_t ip = 0, anchor = 0;
+    while (ip + MIN_MATCH <= size) {
+        uint32_t h = Hash(Read32(in + ip));
+        size_t candidate = table[h];
+        table[h] = uint32_t(ip + 1);
+        if (candidate && ip - (candidate - 1) <= MAX_OFFSET && Read32(in + candidate - 1) == Read32(in + ip)) {
+            size_t from = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (ip + length < size && in[from + length] == in[ip + length]) length++;
+            PutSequence(out, in + anchor, ip - anchor, ip - from, length);
+            ip += length;
+            anchor = ip;
+        } else {
+            // Skip faster through data that doesn't compress.
+            ip += 1 + ((ip - anchor) >> 6);
+        }
+    }
+    PutSequence(out, in + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+inline bool GetLength(const char*& p, const char* end, size_t& n) {
+    while (true) {
+        if (p >= end) return false;
+        uint8_t b = uint8_t(*p++);
+        n += b;
+        if (b != 255) return true;
+    }
+}
+
+// Returns false on corrupt input or if the output would not be exactly
+// expectedSize bytes.
+inline bool Decompress(const char* in, size_t size, size_t expectedSize, string& out) {
+    out.clear();
+    out.reserve(expectedSize);
+    const char* p = in;
+    const char* end = in + size;
+    while (p < end) {
+        uint8_t token = uint8_t(*p++);
+        size_t literals = token >> 4;
+        if (literals == 15 && !GetLength(p, end, literals)) return false;
+        if (literals > size_t(end - p) || out.size() + literals > expectedSize) return false;
+        out.append(p, literals);
+        p += literals;
+        if (p == end) break;
+
+        if (end - p < 2) return false;
+        size_t offset = uint8_t(p[0]) | (size_t(uint8_t(p[1])) << 8);
+        p += 2;
+        size_t length = token & 15;
+        if (length == 15 && !GetLength(p, end, length)) return false;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + length > expectedSize) return false;
+
+        // An overlapping match repeats the last offset bytes; copy it one
+        // period at a time.
+        size_t from = out.size() - offset;
+        while (length > 0) {
+            size_t chunk = offset < length ? offset : length;
+            out.append(out, from, chunk);
+            from += chunk;
+            length -= chunk;
+        }
+    }
+    return out.size() == expectedSize;
+}
+
+}
+
+#endif
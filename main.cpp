@@ -1,8 +1,11 @@
 #include <iostream>
+#include <string>
+#include <cstdlib>
 #include "logger.h"
 #include "pipe_manager.h"
 #include "compress_manager.h"
 #include "file_manager.h"
+#include "journal.h"
 #include "ui_controller.h"
 
 using namespace std;
@@ -14,25 +17,56 @@ private:
     int nextCompressId = 1;
     PipeManager pipeManager;
     CompressManager compressManager;
+    Journal journal;
     FileManager fileManager;
     UIController ui;
 
+    // Pages records out to pipes.pages / stations.pages, splitting
+    // poolBytes between them. The column mirrors are dropped, since they
+    // would keep a copy of every record in memory.
+    void UsePagedStorage(size_t poolBytes) {
+        PagedStorageConfig config;
+        config.poolBytes = poolBytes / 2;
+        config.path = "pipes.pages";
+        bool pipesPaged = pipeManager.UsePagedStorage(config);
+        config.path = "stations.pages";
+        bool stationsPaged = compressManager.UsePagedStorage(config);
+        if (!pipesPaged || !stationsPaged) {
+            cout << "Warning: Could not create paged storage files; keeping records in memory.\n";
+            logger.Log(LogLevel::Warning, LogCategory::Storage, "WARNING: Paged storage unavailable");
+            pipeManager.UseMemoryStorage();
+            compressManager.UseMemoryStorage();
+            return;
+        }
+        pipeManager.SetColumnar(false);
+        compressManager.SetColumnar(false);
+        logger.Log(LogLevel::Info, LogCategory::Storage,
+                   "PAGED STORAGE - Pool: " + to_string(poolBytes >> 20) + " MB");
+    }
+
 public:
-    Application() 
+    // pagePoolBytes > 0 keeps records in paged storage with that much
+    // of them in memory.
+    explicit Application(size_t pagePoolBytes = 0)
         : pipeManager(nextPipeId, logger),
           compressManager(nextCompressId, logger),
+          journal(pipeManager, compressManager, logger),
           fileManager(logger),
           ui(pipeManager, compressManager, logger, fileManager) {
-        logger.Log("APPLICATION STARTED");
+        logger.Log(LogEvent::AppStarted);
+        if (pagePoolBytes > 0) UsePagedStorage(pagePoolBytes);
+        journal.Open();
     }
 
     ~Application() {
-        logger.Log("APPLICATION CLOSED");
+        logger.Log(LogEvent::AppClosed);
+        logger.Flush();
     }
 
     void Run() {
         int choice;
         while (true) {
+            ui.ReportBackgroundSave();
             cout << "\n===== Main Menu =====\n";
             cout << "1. Add pipe\n";
             cout << "2. Edit pipe by ID\n";
@@ -47,7 +81,9 @@ public:
             cout << "11. Save all data to file\n";
             cout << "12. Load all data from file\n";
             cout << "13. View Operation Logs\n";
-            cout << "14. Exit\n";
+            cout << "14. Export logs to text\n";
+            cout << "15. Import/export CSV\n";
+            cout << "16. Exit\n";
             cout << "Choose an option: ";
             cin >> choice;
 
@@ -70,17 +106,45 @@ public:
             case 9: ui.ViewAllCompress(); break;
             case 10: ui.SearchCompress(); break;
             case 11: ui.SaveData(); break;
-            case 12: ui.LoadData(nextPipeId, nextCompressId); break;
+            case 12: {
+                // A load replaces everything; checkpoint it instead of
+                // journaling each record.
+                JournalPause pause(journal);
+                ui.LoadData(nextPipeId, nextCompressId);
+                break;
+            }
             case 13: ui.ViewLogs(); break;
-            case 14: return;
+            case 14: ui.ExportLogs(); break;
+            case 15: {
+                // Imports go through the bulk path too; checkpoint once.
+                JournalPause pause(journal);
+                ui.CsvExchange(nextPipeId, nextCompressId);
+                break;
+            }
+            case 16:
+                ui.FinishBackgroundSave();
+                return;
             default: cout << "Invalid option.\n";
             }
         }
     }
 };
 
-int main() {
-    Application app;
+// --page-pool-mb=N moves the records to disk-backed pages and keeps at
+// most N MB of them in memory.
+int main(int argc, char* argv[]) {
+    size_t pagePoolBytes = 0;
+    const string poolOption = "--page-pool-mb=";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, poolOption.size(), poolOption) == 0) {
+            pagePoolBytes = size_t(strtoull(arg.c_str() + poolOption.size(), nullptr, 10)) << 20;
+        } else {
+            cout << "Warning: Unknown option " << arg << " ignored.\n";
+        }
+    }
+
+    Application app(pagePoolBytes);
     app.Run();
     return 0;
 }
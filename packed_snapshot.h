@@ -0,0 +1,556 @@
+#ifndef PACKED_SNAPSHOT_H
+#define PACKED_SNAPSHOT_H
+
+#include "structs.h"
+#include "snapshot.h"
+#include "mapped_file.h"
+#include "lz_codec.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+
+using namespace std;
+
+// Compressed snapshot, stored column by column:
+//
+//   PackedSnapshotHeader   fixed 64 bytes
+//   payload                pipe columns, then station columns
+//
+// Every column is a varint byte count followed by its bytes:
+//
+//   ids            varint zigzag delta from the previous id
+//   lengths        fixed-point hundredths as varint (zigzag << 1), or 1
+//                  followed by the raw double when that isn't exact
+//   diameters,     dictionary: varint count, the values (zigzag varints
+//   classes        or strings), then one bit-packed code per record
+//   repair/active  one bit per record
+//   workshops      varint counts
+//   text           varint length per record, then one string block,
+//                  LZ-compressed (lz_codec.h) when that makes it smaller
+//
+// The header holds the record counts and checksums (SnapshotChecksum) of
+// itself and of the payload.
+
+static const char PACKED_SNAPSHOT_MAGIC[8] = {'P', 'I', 'P', 'E', 'P', 'A', 'K', '\n'};
+static constexpr uint32_t PACKED_SNAPSHOT_VERSION = 1;
+
+struct PackedSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t createdAt;         // nanoseconds since the Unix epoch
+    uint64_t pipeCount;
+    uint64_t stationCount;
+    uint64_t payloadSize;
+    uint64_t payloadChecksum;
+    uint64_t headerChecksum;    // every field above
+};
+
+static_assert(sizeof(PackedSnapshotHeader) == 64, "packed snapshot header layout");
+
+namespace packed {
+
+enum BlockMethod : uint8_t { Raw = 0, Lz = 1 };
+
+inline uint64_t ZigZag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t UnZigZag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+inline void PutVarint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += char(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+inline void PutColumn(string& out, const string& column) {
+    PutVarint(out, column.size());
+    out += column;
+}
+
+// Bits needed for codes 0..count-1.
+inline int CodeBits(size_t count) {
+    int bits = 0;
+    while ((size_t(1) << bits) < count) bits++;
+    return bits;
+}
+
+class BitWriter {
+private:
+    string& out;
+    uint64_t pending = 0;
+    int used = 0;
+
+public:
+    explicit BitWriter(string& o) : out(o) {}
+
+    void Put(uint64_t value, int bits) {
+        for (int i = 0; i < bits; i++) {
+            pending |= ((value >> i) & 1) << used;
+            if (++used == 64) Flush();
+        }
+    }
+
+    void Flush() {
+        for (int i = 0; i < used; i += 8) out += char(uint8_t(pending >> i));
+        pending = 0;
+        used = 0;
+    }
+};
+
+class BitReader {
+private:
+    const uint8_t* p;
+    size_t bytes;
+    size_t bit = 0;
+
+public:
+    BitReader(const char* data, size_t size) : p(reinterpret_cast<const uint8_t*>(data)), bytes(size) {}
+
+    bool Has(size_t count, int bits) const { return (count * size_t(bits) + 7) / 8 <= bytes; }
+
+    uint64_t Get(int bits) {
+        uint64_t value = 0;
+        for (int i = 0; i < bits; i++, bit++) value |= uint64_t((p[bit >> 3] >> (bit & 7)) & 1) << i;
+        return value;
+    }
+};
+
+// Sequential, bounds-checked reads; the first failure sticks.
+class Cursor {
+private:
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+public:
+    Cursor(const char* data, size_t size) : p(data), end(data + size) {}
+
+    bool Ok() const { return ok; }
+    bool AtEnd() const { return p == end; }
+
+    uint64_t Varint() {
+        uint64_t v = 0;
+        for (int shift = 0; ok && shift < 64; shift += 7) {
+            if (p == end) break;
+            uint8_t b = uint8_t(*p++);
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    bool Bytes(size_t n, const char*& data) {
+        if (!ok || n > size_t(end - p)) return ok = false;
+        data = p;
+        p += n;
+        return true;
+    }
+
+    // Reads a column and returns a cursor over it.
+    Cursor Column() {
+        const char* data = nullptr;
+        size_t size = size_t(Varint());
+        if (!Bytes(size, data)) return Cursor(p, 0).Failed();
+        return Cursor(data, size);
+    }
+
+    Cursor& Failed() {
+        ok = false;
+        return *this;
+    }
+
+    template<typename N>
+    bool Raw(N& value) {
+        const char* data;
+        if (!Bytes(sizeof(value), data)) return false;
+        memcpy(&value, data, sizeof(value));
+        return true;
+    }
+
+    const char* Position() const { return p; }
+    size_t Remaining() const { return size_t(end - p); }
+};
+
+inline string IdColumn(const vector<int>& ids) {
+    string out;
+    int64_t previous = 0;
+    for (int id : ids) {
+        PutVarint(out, ZigZag(int64_t(id) - previous));
+        previous = id;
+    }
+    return out;
+}
+
+inline string LengthColumn(const vector<double>& lengths) {
+    string out;
+    for (double length : lengths) {
+        double scaled = length * 100;
+        if (isfinite(scaled) && fabs(scaled) < 1e15) {
+            int64_t fixed = llround(scaled);
+            if (double(fixed) / 100 == length) {
+                PutVarint(out, ZigZag(fixed) << 1);
+                continue;
+            }
+        }
+        PutVarint(out, 1);
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    }
+    return out;
+}
+
+inline string BitColumn(const vector<bool>& flags) {
+    string out;
+    BitWriter bits(out);
+    for (bool flag : flags) bits.Put(flag ? 1 : 0, 1);
+    bits.Flush();
+    return out;
+}
+
+inline string VarintColumn(const vector<int>& values) {
+    string out;
+    for (int v : values) PutVarint(out, ZigZag(v));
+    return out;
+}
+
+// Dictionary of distinct values in first-seen order, then the codes.
+template<typename V, typename PutValue>
+string DictionaryColumn(const vector<V>& values, PutValue putValue) {
+    unordered_map<V, uint32_t> codes;
+    vector<const V*> dictionary;
+    vector<uint32_t> coded;
+    coded.reserve(values.size());
+    for (const V& v : values) {
+        auto it = codes.find(v);
+        if (it == codes.end()) {
+            it = codes.emplace(v, uint32_t(dictionary.size())).first;
+            dictionary.push_back(&v);
+        }
+        coded.push_back(it->second);
+    }
+
+    string out;
+    PutVarint(out, dictionary.size());
+    for (const V* v : dictionary) putValue(out, *v);
+    int bits = CodeBits(dictionary.size());
+    BitWriter writer(out);
+    for (uint32_t code : coded) writer.Put(code, bits);
+    writer.Flush();
+    return out;
+}
+
+// Lengths column and string block column for one text field.
+inline void TextColumns(string& out, const vector<const string*>& texts) {
+    string lengths, block;
+    for (const string* s : texts) {
+        PutVarint(lengths, s->size());
+        block += *s;
+    }
+    PutColumn(out, lengths);
+
+    string packedBlock;
+    string compressed = lz::Compress(block.data(), block.size());
+    if (compressed.size() < block.size()) {
+        packedBlock += char(Lz);
+        PutVarint(packedBlock, block.size());
+        packedBlock += compressed;
+    } else {
+        packedBlock += char(Raw);
+        packedBlock += block;
+    }
+    PutColumn(out, packedBlock);
+}
+
+}
+
+inline bool IsPackedSnapshotFile(const string& filename) {
+    ifstream in(filename, ios::binary);
+    char magic[sizeof(PACKED_SNAPSHOT_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, PACKED_SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+// Encodes the records column by column and writes header and payload.
+// Returns false if the file can't be written.
+inline bool WritePackedSnapshot(const string& filename, const vector<Pipe>& pipes, const vector<Compress>& stations) {
+    using namespace packed;
+    string payload;
+
+    {
+        vector<int> ids, diameters;
+        vector<double> lengths;
+        vector<bool> repair;
+        vector<const string*> kmMarks;
+        for (const Pipe& pipe : pipes) {
+            ids.push_back(pipe.id);
+            lengths.push_back(pipe.length);
+            diameters.push_back(pipe.diametr);
+            repair.push_back(pipe.repair);
+            kmMarks.push_back(&pipe.km_mark);
+        }
+        PutColumn(payload, IdColumn(ids));
+        PutColumn(payload, LengthColumn(lengths));
+        PutColumn(payload, DictionaryColumn(diameters, [](string& out, int v) { PutVarint(out, ZigZag(v)); }));
+        PutColumn(payload, BitColumn(repair));
+        TextColumns(payload, kmMarks);
+    }
+
+    {
+        vector<int> ids, counts, working;
+        vector<bool> active;
+        vector<string> classes;
+        vector<const string*> names;
+        for (const Compress& station : stations) {
+            ids.push_back(station.id);
+            counts.push_back(station.workshop_count);
+            working.push_back(station.workshop_working);
+            active.push_back(station.working);
+            classes.push_back(station.classification);
+            names.push_back(&station.name);
+        }
+        PutColumn(payload, IdColumn(ids));
+        PutColumn(payload, VarintColumn(counts));
+        PutColumn(payload, VarintColumn(working));
+        PutColumn(payload, BitColumn(active));
+        PutColumn(payload, DictionaryColumn(classes, [](string& out, const string& s) {
+            PutVarint(out, s.size());
+            out += s;
+        }));
+        TextColumns(payload, names);
+    }
+
+    PackedSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKED_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = PACKED_SNAPSHOT_VERSION;
+    header.headerSize = sizeof(PackedSnapshotHeader);
+    header.createdAt = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count());
+    header.pipeCount = pipes.size();
+    header.stationCount = stations.size();
+    header.payloadSize = payload.size();
+    header.payloadChecksum = SnapshotChecksum(payload.data(), payload.size());
+    header.headerChecksum = SnapshotChecksum(reinterpret_cast<const char*>(&header), offsetof(PackedSnapshotHeader, headerChecksum));
+
+    ofstream out(filename, ios::binary | ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(payload.data(), streamsize(payload.size()));
+    out.close();
+    return !out.fail();
+}
+
+// Reads a packed snapshot. Open() checks the header and checksums and
+// decodes every column; on success the records are in Pipes() and
+// Stations().
+class PackedSnapshotReader {
+private:
+    PackedSnapshotHeader header{};
+    vector<Pipe> pipes;
+    vector<Compress> stations;
+    string error;
+
+    bool Fail(const string& reason) {
+        error = reason;
+        pipes.clear();
+        stations.clear();
+        return false;
+    }
+
+    static bool Ids(packed::Cursor column, size_t count, vector<int>& ids) {
+        ids.resize(count);
+        int64_t previous = 0;
+        for (size_t i = 0; i < count; i++) {
+            previous += packed::UnZigZag(column.Varint());
+            ids[i] = int(previous);
+        }
+        return column.Ok() && column.AtEnd();
+    }
+
+    static bool Varints(packed::Cursor column, size_t count, vector<int>& values) {
+        values.resize(count);
+        for (size_t i = 0; i < count; i++) values[i] = int(packed::UnZigZag(column.Varint()));
+        return column.Ok() && column.AtEnd();
+    }
+
+    static bool Bits(packed::Cursor column, size_t count, vector<bool>& flags) {
+        packed::BitReader bits(column.Position(), column.Remaining());
+        if (!column.Ok() || !bits.Has(count, 1)) return false;
+        flags.resize(count);
+        for (size_t i = 0; i < count; i++) flags[i] = bits.Get(1) != 0;
+        return true;
+    }
+
+    // Reads the dictionary with getValue, then maps each code through it.
+    template<typename V, typename GetValue>
+    static bool Dictionary(packed::Cursor column, size_t count, vector<V>& values, GetValue getValue) {
+        size_t size = size_t(column.Varint());
+        if (!column.Ok() || size > column.Remaining() || (count > 0 && size == 0)) return false;
+        vector<V> dictionary(size);
+        for (auto& v : dictionary) {
+            if (!getValue(column, v)) return false;
+        }
+        int bits = packed::CodeBits(size);
+        packed::BitReader reader(column.Position(), column.Remaining());
+        if (!reader.Has(count, bits)) return false;
+        values.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t code = reader.Get(bits);
+            if (code >= size) return false;
+            values[i] = dictionary[code];
+        }
+        return true;
+    }
+
+    static bool Lengths(packed::Cursor column, size_t count, vector<double>& lengths) {
+        lengths.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t v = column.Varint();
+            if (v & 1) {
+                if (!column.Raw(lengths[i])) return false;
+            } else {
+                lengths[i] = double(packed::UnZigZag(v >> 1)) / 100;
+            }
+        }
+        return column.Ok() && column.AtEnd();
+    }
+
+    // Splits the string block by the lengths column into texts.
+    static bool Texts(packed::Cursor lengths, packed::Cursor blockColumn, size_t count, vector<string>& texts) {
+        const char* methodByte;
+        if (!blockColumn.Bytes(1, methodByte)) return false;
+        string inflated;
+        const char* block = blockColumn.Position();
+        size_t blockSize = blockColumn.Remaining();
+        if (uint8_t(*methodByte) == packed::Lz) {
+            size_t rawSize = size_t(blockColumn.Varint());
+            if (!blockColumn.Ok() || rawSize / 256 > blockColumn.Remaining() + 1 ||
+                !lz::Decompress(blockColumn.Position(), blockColumn.Remaining(), rawSize, inflated)) {
+                return false;
+            }
+            block = inflated.data();
+            blockSize = inflated.size();
+        } else if (uint8_t(*methodByte) != packed::Raw) {
+            return false;
+        }
+
+        texts.resize(count);
+        size_t offset = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t length = size_t(lengths.Varint());
+            if (!lengths.Ok() || length > blockSize - offset) return false;
+            texts[i].assign(block + offset, length);
+            offset += length;
+        }
+        return lengths.AtEnd() && offset == blockSize;
+    }
+
+    static bool DictionaryString(packed::Cursor& column, string& s) {
+        const char* data;
+        size_t length = size_t(column.Varint());
+        if (!column.Bytes(length, data)) return false;
+        s.assign(data, length);
+        return true;
+    }
+
+    bool DecodePipes(packed::Cursor& payload, size_t count) {
+        vector<int> ids, diameters;
+        vector<double> lengths;
+        vector<bool> repair;
+        vector<string> kmMarks;
+        if (!Ids(payload.Column(), count, ids)) return Fail("bad pipe ids");
+        if (!Lengths(payload.Column(), count, lengths)) return Fail("bad pipe lengths");
+        if (!Dictionary(payload.Column(), count, diameters, [](packed::Cursor& c, int& v) {
+                v = int(packed::UnZigZag(c.Varint()));
+                return c.Ok();
+            })) {
+            return Fail("bad pipe diameters");
+        }
+        if (!Bits(payload.Column(), count, repair)) return Fail("bad pipe repair flags");
+        packed::Cursor kmLengths = payload.Column();
+        if (!Texts(kmLengths, payload.Column(), count, kmMarks)) return Fail("bad pipe km marks");
+
+        pipes.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            Pipe& pipe = pipes[i];
+            pipe.id = ids[i];
+            pipe.km_mark = move(kmMarks[i]);
+            pipe.length = lengths[i];
+            pipe.diametr = diameters[i];
+            pipe.repair = repair[i];
+        }
+        return true;
+    }
+
+    bool DecodeStations(packed::Cursor& payload, size_t count) {
+        vector<int> ids, counts, working;
+        vector<bool> active;
+        vector<string> classes, names;
+        if (!Ids(payload.Column(), count, ids)) return Fail("bad station ids");
+        if (!Varints(payload.Column(), count, counts)) return Fail("bad workshop counts");
+        if (!Varints(payload.Column(), count, working)) return Fail("bad working workshop counts");
+        if (!Bits(payload.Column(), count, active)) return Fail("bad station active flags");
+        if (!Dictionary(payload.Column(), count, classes, DictionaryString)) return Fail("bad station classifications");
+        packed::Cursor nameLengths = payload.Column();
+        if (!Texts(nameLengths, payload.Column(), count, names)) return Fail("bad station names");
+
+        stations.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            Compress& station = stations[i];
+            station.id = ids[i];
+            station.name = move(names[i]);
+            station.workshop_count = counts[i];
+            station.workshop_working = working[i];
+            station.classification = move(classes[i]);
+            station.working = active[i];
+        }
+        return true;
+    }
+
+public:
+    bool Open(const string& filename) {
+        error.clear();
+        pipes.clear();
+        stations.clear();
+
+        MappedFile file;
+        if (!file.Open(filename)) return Fail("cannot open file");
+        if (file.Size() < sizeof(PackedSnapshotHeader)) return Fail("file too short");
+        memcpy(&header, file.Data(), sizeof(header));
+        if (memcmp(header.magic, PACKED_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) return Fail("not a packed snapshot");
+        if (header.version != PACKED_SNAPSHOT_VERSION) return Fail("unsupported version " + to_string(header.version));
+        if (header.headerChecksum != SnapshotChecksum(file.Data(), offsetof(PackedSnapshotHeader, headerChecksum)))
+            return Fail("header checksum mismatch");
+        if (header.headerSize != sizeof(PackedSnapshotHeader) || header.headerSize + header.payloadSize != file.Size())
+            return Fail("payload size does not match the file");
+        // Every record takes at least one byte of ids.
+        if (header.pipeCount > header.payloadSize || header.stationCount > header.payloadSize)
+            return Fail("record counts do not match the payload");
+
+        const char* data = file.Data() + header.headerSize;
+        if (header.payloadChecksum != SnapshotChecksum(data, header.payloadSize)) return Fail("payload checksum mismatch");
+
+        packed::Cursor payload(data, header.payloadSize);
+        if (!DecodePipes(payload, header.pipeCount) || !DecodeStations(payload, header.stationCount)) return false;
+        if (!payload.Ok() || !payload.AtEnd()) return Fail("trailing bytes after the last column");
+        return true;
+    }
+
+    // Why the last Open() failed.
+    const string& Error() const { return error; }
+
+    size_t PipeCount() const { return pipes.size(); }
+    size_t StationCount() const { return stations.size(); }
+    int64_t CreatedAt() const { return static_cast<int64_t>(header.createdAt); }
+
+    vector<Pipe>& Pipes() { return pipes; }
+    vector<Compress>& Stations() { return stations; }
+};
+
+#endif
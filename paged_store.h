@@ -0,0 +1,442 @@
+#ifndef PAGED_STORE_H
+#define PAGED_STORE_H
+
+#include "slot_map.h"
+#include "record_codec.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <array>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+
+struct PagedStorageConfig {
+    string path;                        // data file; truncated on open, removed on close
+    size_t pageBytes = 8 * 1024;        // 1 KB .. 32 KB
+    size_t poolBytes = 16ull << 20;     // resident pages, at least two
+};
+
+struct BufferPoolStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t writes = 0;
+};
+
+// Fixed-size pages of a data file, of which at most Capacity() are kept
+// in memory. Pages are evicted least recently used first and written
+// back only if dirty. A pointer from Fetch() or Allocate() is valid
+// until the next call to either. After a failed read or write Failed()
+// stays true: the file no longer holds every record.
+class BufferPool {
+private:
+    struct Frame {
+        uint32_t page;
+        bool dirty;
+        vector<char> data;
+    };
+
+    static constexpr uint32_t UNUSED_FRAME = UINT32_MAX;
+
+    fstream file;
+    string path;
+    size_t pageBytes = 0;
+    size_t capacity = 0;
+    uint32_t pageCount = 0;
+    list<Frame> frames;                 // most recently used first
+    unordered_map<uint32_t, list<Frame>::iterator> resident;
+    BufferPoolStats stats;
+    bool ioError = false;
+
+    void WriteBack(const Frame& frame) {
+        file.seekp(streamoff(frame.page) * streamoff(pageBytes));
+        file.write(frame.data.data(), streamsize(pageBytes));
+        if (!file) {
+            ioError = true;
+            file.clear();
+        }
+        stats.writes++;
+    }
+
+    // A frame for page at the front of the list, evicting the least
+    // recently used one when the pool is full. Its contents are stale.
+    Frame& Claim(uint32_t page) {
+        if (frames.size() >= capacity) {
+            auto last = prev(frames.end());
+            if (last->dirty) WriteBack(*last);
+            resident.erase(last->page);
+            frames.splice(frames.begin(), frames, last);
+            stats.evictions++;
+        } else {
+            frames.push_front(Frame{0, false, vector<char>(pageBytes)});
+        }
+        Frame& frame = frames.front();
+        frame.page = page;
+        frame.dirty = false;
+        resident[page] = frames.begin();
+        return frame;
+    }
+
+public:
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool() { Close(); }
+
+    bool Open(const string& filename, size_t pageSize, size_t poolBytes) {
+        Close();
+        path = filename;
+        pageBytes = pageSize;
+        capacity = max<size_t>(2, poolBytes / pageSize);
+        file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+        ioError = false;
+        return file.is_open();
+    }
+
+    // Drops every page and removes the data file.
+    void Close() {
+        if (!file.is_open()) return;
+        file.close();
+        remove(path.c_str());
+        frames.clear();
+        resident.clear();
+        pageCount = 0;
+    }
+
+    // Forgets all pages; the file is reused from the start.
+    void Reset() {
+        frames.clear();
+        resident.clear();
+        pageCount = 0;
+    }
+
+    // The page's bytes, or nullptr if it can't be read.
+    char* Fetch(uint32_t page, bool dirty) {
+        auto it = resident.find(page);
+        if (it != resident.end()) {
+            stats.hits++;
+            frames.splice(frames.begin(), frames, it->second);
+        } else {
+            stats.misses++;
+            Frame& frame = Claim(page);
+            file.seekg(streamoff(page) * streamoff(pageBytes));
+            file.read(frame.data.data(), streamsize(pageBytes));
+            if (!file) {
+                // The frame still holds the evicted page; it goes back
+                // to the end of the list to be claimed first.
+                ioError = true;
+                file.clear();
+                resident.erase(page);
+                frame.page = UNUSED_FRAME;
+                frames.splice(frames.end(), frames, frames.begin());
+                return nullptr;
+            }
+        }
+        Frame& frame = frames.front();
+        frame.dirty = frame.dirty || dirty;
+        return frame.data.data();
+    }
+
+    // A new zero-filled page, resident and dirty.
+    uint32_t Allocate(char*& data) {
+        Frame& frame = Claim(pageCount);
+        memset(frame.data.data(), 0, pageBytes);
+        frame.dirty = true;
+        data = frame.data.data();
+        return pageCount++;
+    }
+
+    size_t PageBytes() const { return pageBytes; }
+    size_t Capacity() const { return capacity; }
+    size_t PageCount() const { return pageCount; }
+    size_t ResidentPages() const { return frames.size(); }
+    const BufferPoolStats& Stats() const { return stats; }
+    // True once a page read or write has failed.
+    bool Failed() const { return ioError; }
+};
+
+// Record storage with the SlotMap interface whose records live encoded
+// (record_codec.h) in slotted pages behind a BufferPool, so the memory
+// they take is capped by the pool size instead of the data set. Only the
+// handle table (a SlotMap of 8-byte page references) stays in memory.
+//
+// Page layout: a PageHeader, record bytes growing up from it, and a
+// directory of (offset, length) slots growing down from the end of the
+// page; length 0 marks a free slot. Deletes and shrinking updates leave
+// dead bytes that are compacted away when the page is written again.
+// Records too large for a page are kept in memory.
+//
+// Get() decodes into one of READ_SLOTS buffers, so a pointer it returns
+// survives the next READ_SLOTS - 1 reads. Records can't be changed
+// through it: use Assign().
+template<typename T>
+class PagedStore {
+private:
+    struct RecordRef {
+        uint32_t page;
+        uint32_t slot;
+    };
+
+    struct PageHeader {
+        uint16_t slotCount;
+        uint16_t dataEnd;
+        uint16_t deadBytes;
+        uint16_t freeSlots;
+    };
+
+    struct SlotEntry {
+        uint16_t offset;
+        uint16_t length;
+    };
+
+    static constexpr uint32_t NO_PAGE = UINT32_MAX;
+    static constexpr uint32_t IN_MEMORY = UINT32_MAX - 1;
+    static constexpr size_t READ_SLOTS = 16;
+
+    SlotMap<RecordRef> refs;
+    mutable BufferPool pool;
+    mutable mutex poolMutex;
+    size_t pageBytes = 0;
+    uint32_t fillPage = NO_PAGE;
+    vector<uint32_t> reclaimed;          // pages that got room back
+    unordered_map<uint32_t, T> oversized;
+    uint32_t nextOversized = 0;
+    string encoded;
+    mutable array<T, READ_SLOTS> reads;
+    mutable size_t nextRead = 0;
+
+    PageHeader& Header(char* page) const { return *reinterpret_cast<PageHeader*>(page); }
+
+    SlotEntry& Entry(char* page, uint32_t slot) const {
+        return *reinterpret_cast<SlotEntry*>(page + pageBytes - (slot + 1) * sizeof(SlotEntry));
+    }
+
+    size_t FreeBytes(char* page) const {
+        const PageHeader& h = Header(page);
+        return pageBytes - h.slotCount * sizeof(SlotEntry) - h.dataEnd;
+    }
+
+    void Compact(char* page) const {
+        PageHeader& h = Header(page);
+        vector<char> data(page + sizeof(PageHeader), page + h.dataEnd);
+        uint16_t end = sizeof(PageHeader);
+        for (uint32_t s = 0; s < h.slotCount; s++) {
+            SlotEntry& e = Entry(page, s);
+            if (e.length == 0) continue;
+            memcpy(page + end, data.data() + (e.offset - sizeof(PageHeader)), e.length);
+            e.offset = end;
+            end = uint16_t(end + e.length);
+        }
+        h.dataEnd = end;
+        h.deadBytes = 0;
+    }
+
+    // Copies encoded into page; false if it doesn't fit even compacted.
+    bool Place(char* page, uint32_t& slot) const {
+        PageHeader& h = Header(page);
+        size_t needed = encoded.size() + (h.freeSlots > 0 ? 0 : sizeof(SlotEntry));
+        if (FreeBytes(page) < needed) {
+            if (FreeBytes(page) + h.deadBytes < needed) return false;
+            Compact(page);
+        }
+        if (h.freeSlots > 0) {
+            for (slot = 0; Entry(page, slot).length != 0; slot++) {}
+            h.freeSlots--;
+        } else {
+            slot = h.slotCount++;
+        }
+        memcpy(page + h.dataEnd, encoded.data(), encoded.size());
+        Entry(page, slot) = {h.dataEnd, uint16_t(encoded.size())};
+        h.dataEnd = uint16_t(h.dataEnd + encoded.size());
+        return true;
+    }
+
+    // Writes encoded to a page with room: the page being filled, then
+    // pages that got space back, then a new one.
+    RecordRef StoreEncoded(const T& value) {
+        if (encoded.size() + sizeof(PageHeader) + sizeof(SlotEntry) > pageBytes) {
+            oversized[nextOversized] = value;
+            return {IN_MEMORY, nextOversized++};
+        }
+        uint32_t slot;
+        char* fill = fillPage != NO_PAGE ? pool.Fetch(fillPage, true) : nullptr;
+        if (fill && Place(fill, slot)) return {fillPage, slot};
+        while (!reclaimed.empty()) {
+            uint32_t page = reclaimed.back();
+            reclaimed.pop_back();
+            char* data = page != fillPage ? pool.Fetch(page, true) : nullptr;
+            if (data && Place(data, slot)) {
+                fillPage = page;
+                return {page, slot};
+            }
+        }
+        char* page;
+        fillPage = pool.Allocate(page);
+        Header(page).dataEnd = sizeof(PageHeader);
+        Place(page, slot);
+        return {fillPage, slot};
+    }
+
+    RecordRef Store(const T& value) {
+        encoded.clear();
+        EncodeRecord(encoded, value);
+        return StoreEncoded(value);
+    }
+
+    void Free(const RecordRef& ref) {
+        if (ref.page == IN_MEMORY) {
+            oversized.erase(ref.slot);
+            return;
+        }
+        char* page = pool.Fetch(ref.page, true);
+        if (!page) return;
+        SlotEntry& e = Entry(page, ref.slot);
+        AddDeadBytes(ref.page, page, e.length);
+        e = {0, 0};
+        Header(page).freeSlots++;
+    }
+
+    // A page that reaches half dead bytes can take new records again.
+    void AddDeadBytes(uint32_t pageNumber, char* page, size_t bytes) {
+        PageHeader& h = Header(page);
+        bool wasHalfFull = h.deadBytes < pageBytes / 2;
+        h.deadBytes = uint16_t(h.deadBytes + bytes);
+        if (wasHalfFull && h.deadBytes >= pageBytes / 2) reclaimed.push_back(pageNumber);
+    }
+
+    bool Decode(char* page, uint32_t slot, T& out) const {
+        const SlotEntry& e = Entry(page, slot);
+        return e.length != 0 && DecodeRecord(page + e.offset, page + e.offset + e.length, out);
+    }
+
+    bool Read(const RecordRef& ref, T& out) const {
+        if (ref.page == IN_MEMORY) {
+            out = oversized.at(ref.slot);
+            return true;
+        }
+        char* page = pool.Fetch(ref.page, false);
+        return page && Decode(page, ref.slot, out);
+    }
+
+public:
+    PagedStore() = default;
+    PagedStore(const PagedStore&) = delete;
+    PagedStore& operator=(const PagedStore&) = delete;
+
+    bool Open(const PagedStorageConfig& config) {
+        pageBytes = min<size_t>(32 * 1024, max<size_t>(1024, config.pageBytes));
+        return pool.Open(config.path, pageBytes, config.poolBytes);
+    }
+
+    Handle Insert(const T& value) {
+        lock_guard<mutex> lock(poolMutex);
+        return refs.Insert(Store(value));
+    }
+
+    bool Contains(Handle h) const { return refs.Contains(h); }
+
+    const T* Get(Handle h) const {
+        lock_guard<mutex> lock(poolMutex);
+        const RecordRef* ref = refs.Get(h);
+        if (!ref) return nullptr;
+        T& out = reads[nextRead++ % READ_SLOTS];
+        return Read(*ref, out) ? &out : nullptr;
+    }
+
+    // Replaces the record behind h. It stays in place if it still fits.
+    bool Assign(Handle h, const T& value) {
+        lock_guard<mutex> lock(poolMutex);
+        RecordRef* ref = refs.Get(h);
+        if (!ref) return false;
+        encoded.clear();
+        EncodeRecord(encoded, value);
+        if (ref->page != IN_MEMORY) {
+            char* page = pool.Fetch(ref->page, true);
+            if (page && encoded.size() <= Entry(page, ref->slot).length) {
+                SlotEntry& e = Entry(page, ref->slot);
+                memcpy(page + e.offset, encoded.data(), encoded.size());
+                AddDeadBytes(ref->page, page, e.length - encoded.size());
+                e.length = uint16_t(encoded.size());
+                return true;
+            }
+        }
+        Free(*ref);
+        *ref = StoreEncoded(value);
+        return true;
+    }
+
+    Handle HandleOfSlot(uint32_t slot) const { return refs.HandleOfSlot(slot); }
+    Handle HandleAt(size_t position) const { return refs.HandleAt(position); }
+    size_t PositionOf(Handle h) const { return refs.PositionOf(h); }
+
+    bool Erase(Handle h) {
+        lock_guard<mutex> lock(poolMutex);
+        const RecordRef* ref = refs.Get(h);
+        if (!ref) return false;
+        Free(*ref);
+        return refs.Erase(h);
+    }
+
+    void Clear() {
+        lock_guard<mutex> lock(poolMutex);
+        refs.Clear();
+        pool.Reset();
+        fillPage = NO_PAGE;
+        reclaimed.clear();
+        oversized.clear();
+    }
+
+    void Reserve(size_t n) { refs.Reserve(n); }
+
+    size_t Size() const { return refs.Size(); }
+    bool Empty() const { return refs.Empty(); }
+
+    // Calls f(record, position) for positions [begin, end). Safe to call
+    // from several threads at once, but not alongside changes. The pool
+    // is locked only to copy each page out; records are decoded from the
+    // copy, and neighbouring positions mostly share a page.
+    template<typename F>
+    void ForEachInRange(size_t begin, size_t end, F f) const {
+        T item;
+        vector<char> copy(pageBytes);
+        uint32_t copied = NO_PAGE;
+        for (size_t i = begin; i < end; i++) {
+            const RecordRef& ref = refs.Values()[i];
+            if (ref.page == IN_MEMORY) {
+                f(oversized.at(ref.slot), i);
+                continue;
+            }
+            if (ref.page != copied) {
+                lock_guard<mutex> lock(poolMutex);
+                const char* page = pool.Fetch(ref.page, false);
+                copied = page ? ref.page : NO_PAGE;
+                if (page) memcpy(copy.data(), page, pageBytes);
+            }
+            if (ref.page == copied && Decode(copy.data(), ref.slot, item)) f(item, i);
+        }
+    }
+
+    size_t PageCount() const { return pool.PageCount(); }
+    size_t ResidentBytes() const { return pool.ResidentPages() * pageBytes; }
+    size_t PoolBytes() const { return pool.Capacity() * pageBytes; }
+    BufferPoolStats Stats() const {
+        lock_guard<mutex> lock(poolMutex);
+        return pool.Stats();
+    }
+    // True once a page couldn't be read or written; records may be
+    // missing from reads, so the data must not be saved from here.
+    bool Failed() const {
+        lock_guard<mutex> lock(poolMutex);
+        return pool.Failed();
+    }
+};
+
+#endif
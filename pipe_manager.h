@@ -3,31 +3,69 @@
 
 #include "structs.h"
 #include "generic_manager.h"
-#include <iomanip>
-#include <sstream>
+#include "columns.h"
+#include "sorted_index.h"
+#include "bitmap_index.h"
+#include "trigram_index.h"
 
 using namespace std;
 
 class PipeManager : public GenericManager<Pipe> {
 public:
-    PipeManager(int& id, Logger& log) : GenericManager<Pipe>(id, log) {}
+    PipeManager(int& id, Logger& log)
+        : GenericManager<Pipe>(id, log),
+          lengthIndex([](const Pipe& p, double& key) { key = p.length; return true; }),
+          diameterIndex([](const Pipe& p, int& key) { key = p.diametr; return true; }),
+          diameterBitmaps([](const Pipe& p) { return p.diametr; }),
+          repairBitmaps([](const Pipe& p) { return p.repair; }),
+          kmMarkTrigrams([](const Pipe& p) -> const string& { return p.km_mark; }) {
+        Subscribe(&lengthIndex);
+        Subscribe(&diameterIndex);
+        Subscribe(&diameterBitmaps);
+        Subscribe(&repairBitmaps);
+        Subscribe(&kmMarkTrigrams);
+        SetColumnar(true);
+    }
+
+    // Columnar mode keeps a PipeColumns mirror that numeric searches scan
+    // instead of the row records.
+    void SetColumnar(bool enabled) {
+        if (enabled == columnar) return;
+        columnar = enabled;
+        if (enabled) {
+            Subscribe(&columns);
+        } else {
+            Unsubscribe(&columns);
+            columns.OnCleared();
+        }
+    }
+
+    const PipeColumns* Columns() const { return columnar ? &columns : nullptr; }
+    const SortedIndex<Pipe, double>& LengthIndex() const { return lengthIndex; }
+    const SortedIndex<Pipe, int>& DiameterIndex() const { return diameterIndex; }
+    const BitmapIndex<Pipe, int>& DiameterBitmaps() const { return diameterBitmaps; }
+    const BitmapIndex<Pipe, bool>& RepairBitmaps() const { return repairBitmaps; }
+    const TrigramIndex<Pipe>& KmMarkTrigrams() const { return kmMarkTrigrams; }
 
 private:
+    PipeColumns columns;
+    bool columnar = false;
+    SortedIndex<Pipe, double> lengthIndex;
+    SortedIndex<Pipe, int> diameterIndex;
+    BitmapIndex<Pipe, int> diameterBitmaps;
+    BitmapIndex<Pipe, bool> repairBitmaps;
+    TrigramIndex<Pipe> kmMarkTrigrams;
+
     void OnAdd(const Pipe& pipe) override {
-        stringstream ss;
-        ss << "ADDED PIPE - ID: " << pipe.id << ", KM Mark: " << pipe.km_mark 
-           << ", Length: " << fixed << setprecision(2) << pipe.length << " km"
-           << ", Diameter: " << pipe.diametr << " mm"
-           << ", On repair: " << (pipe.repair ? "Yes" : "No");
-        logger.Log(ss.str());
+        logger.Log(LogEvent::AddedPipe, pipe.id, pipe.km_mark, pipe.length, pipe.diametr, pipe.repair);
+    }
+
+    void OnAddRange(size_t count) override {
+        logger.Log(LogEvent::AddedPipeRange, count, Size());
     }
 
     void OnDelete(const Pipe& pipe) override {
-        stringstream ss;
-        ss << "DELETED PIPE - ID: " << pipe.id << ", KM Mark: " << pipe.km_mark 
-           << ", Length: " << fixed << setprecision(2) << pipe.length << " km"
-           << ", Diameter: " << pipe.diametr << " mm";
-        logger.Log(ss.str());
+        logger.Log(LogEvent::DeletedPipe, pipe.id, pipe.km_mark, pipe.length, pipe.diametr);
     }
 };
 
@@ -0,0 +1,97 @@
+#ifndef PREDICATES_H
+#define PREDICATES_H
+
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// Predicate building blocks passed to GenericSearchEngine::SearchByCondition
+// as template arguments, so a combined filter compiles into one loop
+// without an indirect call per record:
+//
+//   AllOf(FieldEquals(&Pipe::diametr, 1420), FieldBetween(&Pipe::length, 10.0, 50.0))
+
+template<typename A, typename B>
+struct AndPredicate {
+    A a;
+    B b;
+
+    template<typename T>
+    constexpr bool operator()(const T& item) const { return a(item) && b(item); }
+};
+
+template<typename A, typename B>
+struct OrPredicate {
+    A a;
+    B b;
+
+    template<typename T>
+    constexpr bool operator()(const T& item) const { return a(item) || b(item); }
+};
+
+template<typename A>
+struct NotPredicate {
+    A a;
+
+    template<typename T>
+    constexpr bool operator()(const T& item) const { return !a(item); }
+};
+
+template<typename A, typename B>
+constexpr AndPredicate<A, B> And(A a, B b) { return {a, b}; }
+
+template<typename A, typename B>
+constexpr OrPredicate<A, B> Or(A a, B b) { return {a, b}; }
+
+template<typename A>
+constexpr NotPredicate<A> Not(A a) { return {a}; }
+
+template<typename A>
+constexpr A AllOf(A a) { return a; }
+
+template<typename A, typename B, typename... Rest>
+constexpr auto AllOf(A a, B b, Rest... rest) { return AllOf(And(a, b), rest...); }
+
+template<typename A>
+constexpr A AnyOf(A a) { return a; }
+
+template<typename A, typename B, typename... Rest>
+constexpr auto AnyOf(A a, B b, Rest... rest) { return AnyOf(Or(a, b), rest...); }
+
+template<typename T, typename V>
+struct FieldEqualsPredicate {
+    V T::*field;
+    V value;
+
+    constexpr bool operator()(const T& item) const { return item.*field == value; }
+};
+
+template<typename T, typename V>
+struct FieldBetweenPredicate {
+    V T::*field;
+    V lo;
+    V hi;
+
+    constexpr bool operator()(const T& item) const { return item.*field >= lo && item.*field <= hi; }
+};
+
+template<typename T>
+struct FieldContainsPredicate {
+    string T::*field;
+    const string* text;
+
+    bool operator()(const T& item) const { return (item.*field).find(*text) != string::npos; }
+};
+
+template<typename T, typename V>
+constexpr FieldEqualsPredicate<T, V> FieldEquals(V T::*field, V value) { return {field, value}; }
+
+template<typename T, typename V>
+constexpr FieldBetweenPredicate<T, V> FieldBetween(V T::*field, V lo, V hi) { return {field, lo, hi}; }
+
+// text must outlive the predicate.
+template<typename T>
+FieldContainsPredicate<T> FieldContains(string T::*field, const string& text) { return {field, &text}; }
+
+#endif
@@ -0,0 +1,928 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "structs.h"
+#include "pipe_manager.h"
+#include "compress_manager.h"
+#include "simd_filters.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cctype>
+#include <limits>
+
+using namespace std;
+
+enum class QueryOp { Eq, Ne, Lt, Le, Gt, Ge, Between, Contains };
+
+// AND/OR/NOT tree over field predicates. Leaves compare a field with a
+// number (lo, and hi for Between) or with text.
+struct Query {
+    enum class Kind { Leaf, And, Or, Not };
+
+    Kind kind = Kind::Leaf;
+    string field;
+    QueryOp op = QueryOp::Eq;
+    double lo = 0;
+    double hi = 0;
+    string text;
+    bool numeric = false;
+    vector<Query> children;
+
+    static Query Where(const string& field, QueryOp op, double value) {
+        Query q;
+        q.field = field;
+        q.op = op;
+        q.lo = q.hi = value;
+        q.text = FormatNumber(value);
+        q.numeric = true;
+        return q;
+    }
+
+    static Query Between(const string& field, double lo, double hi) {
+        Query q = Where(field, QueryOp::Between, lo);
+        q.hi = hi;
+        q.text = FormatNumber(lo) + ".." + FormatNumber(hi);
+        return q;
+    }
+
+    static Query Text(const string& field, QueryOp op, const string& text) {
+        Query q;
+        q.field = field;
+        q.op = op;
+        q.text = text;
+        return q;
+    }
+
+    static Query Combine(Kind kind, Query a, Query b) {
+        if (a.kind == kind) {
+            a.children.push_back(move(b));
+            return a;
+        }
+        Query q;
+        q.kind = kind;
+        q.children.push_back(move(a));
+        q.children.push_back(move(b));
+        return q;
+    }
+
+    friend Query operator&&(Query a, Query b) { return Combine(Kind::And, move(a), move(b)); }
+    friend Query operator||(Query a, Query b) { return Combine(Kind::Or, move(a), move(b)); }
+
+    friend Query operator!(Query a) {
+        Query q;
+        q.kind = Kind::Not;
+        q.children.push_back(move(a));
+        return q;
+    }
+
+    string ToString() const {
+        switch (kind) {
+        case Kind::Leaf: {
+            static const char* ops[] = {"=", "!=", "<", "<=", ">", ">=", "=", "~"};
+            return field + " " + ops[(int)op] + " " + text;
+        }
+        case Kind::Not:
+            return "NOT (" + children[0].ToString() + ")";
+        default: {
+            string joined;
+            for (size_t i = 0; i < children.size(); i++) {
+                if (i > 0) joined += kind == Kind::And ? " AND " : " OR ";
+                joined += children[i].kind == Kind::Leaf ? children[i].ToString() : "(" + children[i].ToString() + ")";
+            }
+            return joined;
+        }
+        }
+    }
+
+    static string FormatNumber(double value) {
+        stringstream ss;
+        ss << value;
+        return ss.str();
+    }
+};
+
+// Text form used by the search menus:
+//   diameter = 1420 AND repair = yes
+//   (length = 10..20 OR km ~ "km-1") AND NOT diameter < 700
+class QueryParser {
+private:
+    vector<string> tokens;
+    size_t pos = 0;
+    string error;
+
+    void Tokenize(const string& text) {
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (isspace((unsigned char)c)) {
+                i++;
+            } else if (c == '(' || c == ')' || c == '~') {
+                tokens.push_back(string(1, c));
+                i++;
+            } else if (c == '<' || c == '>' || c == '!' || c == '=') {
+                if (i + 1 < text.size() && text[i + 1] == '=') {
+                    tokens.push_back(text.substr(i, 2));
+                    i += 2;
+                } else {
+                    tokens.push_back(string(1, c));
+                    i++;
+                }
+            } else if (c == '"') {
+                size_t end = text.find('"', i + 1);
+                if (end == string::npos) end = text.size();
+                tokens.push_back(text.substr(i, end - i));   // keeps the opening quote as a marker
+                i = end + 1;
+            } else {
+                size_t start = i;
+                while (i < text.size() && !isspace((unsigned char)text[i]) &&
+                       string("()~<>!=\"").find(text[i]) == string::npos) {
+                    i++;
+                }
+                tokens.push_back(text.substr(start, i - start));
+            }
+        }
+    }
+
+    static string Upper(string s) {
+        for (auto& c : s) c = (char)toupper((unsigned char)c);
+        return s;
+    }
+
+    bool Peek(const string& keyword) const {
+        return pos < tokens.size() && Upper(tokens[pos]) == keyword;
+    }
+
+    static bool ToNumber(const string& token, double& value) {
+        string t = Upper(token);
+        if (t == "YES" || t == "TRUE") { value = 1; return true; }
+        if (t == "NO" || t == "FALSE") { value = 0; return true; }
+        try {
+            size_t used = 0;
+            value = stod(token, &used);
+            return used == token.size();
+        } catch (...) {
+            return false;
+        }
+    }
+
+    bool ParseOr(Query& out) {
+        if (!ParseAnd(out)) return false;
+        while (Peek("OR")) {
+            pos++;
+            Query rhs;
+            if (!ParseAnd(rhs)) return false;
+            out = move(out) || move(rhs);
+        }
+        return true;
+    }
+
+    bool ParseAnd(Query& out) {
+        if (!ParseFactor(out)) return false;
+        while (Peek("AND")) {
+            pos++;
+            Query rhs;
+            if (!ParseFactor(rhs)) return false;
+            out = move(out) && move(rhs);
+        }
+        return true;
+    }
+
+    bool ParseFactor(Query& out) {
+        if (pos >= tokens.size()) {
+            error = "unexpected end of query";
+            return false;
+        }
+        if (Peek("NOT")) {
+            pos++;
+            Query inner;
+            if (!ParseFactor(inner)) return false;
+            out = !move(inner);
+            return true;
+        }
+        if (tokens[pos] == "(") {
+            pos++;
+            if (!ParseOr(out)) return false;
+            if (pos >= tokens.size() || tokens[pos] != ")") {
+                error = "missing ')'";
+                return false;
+            }
+            pos++;
+            return true;
+        }
+        return ParsePredicate(out);
+    }
+
+    bool ParsePredicate(Query& out) {
+        if (pos + 2 >= tokens.size()) {
+            error = "incomplete condition near '" + tokens[pos] + "'";
+            return false;
+        }
+        string field = tokens[pos];
+        for (auto& c : field) c = (char)tolower((unsigned char)c);
+        string opToken = tokens[pos + 1];
+        string value = tokens[pos + 2];
+        pos += 3;
+
+        bool quoted = !value.empty() && value[0] == '"';
+        if (quoted) value = value.substr(1);
+
+        static const pair<const char*, QueryOp> ops[] = {
+            {"=", QueryOp::Eq}, {"!=", QueryOp::Ne}, {"<", QueryOp::Lt}, {"<=", QueryOp::Le},
+            {">", QueryOp::Gt}, {">=", QueryOp::Ge}, {"~", QueryOp::Contains}};
+        QueryOp op = QueryOp::Eq;
+        bool known = false;
+        for (const auto& entry : ops) {
+            if (opToken == entry.first) {
+                op = entry.second;
+                known = true;
+            }
+        }
+        if (!known) {
+            error = "unknown operator '" + opToken + "'";
+            return false;
+        }
+
+        size_t dots = value.find("..");
+        double lo, hi;
+        if (!quoted && op == QueryOp::Eq && dots != string::npos &&
+            ToNumber(value.substr(0, dots), lo) && ToNumber(value.substr(dots + 2), hi)) {
+            out = Query::Between(field, lo, hi);
+        } else if (!quoted && op != QueryOp::Contains && ToNumber(value, lo)) {
+            out = Query::Where(field, op, lo);
+            out.text = value;
+        } else {
+            out = Query::Text(field, op, value);
+        }
+        return true;
+    }
+
+public:
+    bool Parse(const string& text, Query& out, string& errorMessage) {
+        tokens.clear();
+        pos = 0;
+        error.clear();
+        Tokenize(text);
+        if (tokens.empty()) {
+            errorMessage = "empty query";
+            return false;
+        }
+        if (!ParseOr(out)) {
+            errorMessage = error;
+            return false;
+        }
+        if (pos != tokens.size()) {
+            errorMessage = "unexpected '" + tokens[pos] + "'";
+            return false;
+        }
+        return true;
+    }
+};
+
+enum class AccessPath { IdLookup, RangeIndex, Bitmap, Trigram, ColumnScan, IndexUnion, Scan };
+
+inline const char* AccessPathName(AccessPath path) {
+    switch (path) {
+    case AccessPath::IdLookup: return "ID LOOKUP";
+    case AccessPath::RangeIndex: return "RANGE INDEX";
+    case AccessPath::Bitmap: return "BITMAP";
+    case AccessPath::Trigram: return "TRIGRAM";
+    case AccessPath::ColumnScan: return "COLUMN SCAN";
+    case AccessPath::IndexUnion: return "INDEX UNION";
+    default: return "SCAN";
+    }
+}
+
+struct PathOption {
+    AccessPath path;
+    size_t estimate;   // rows
+    size_t cost;       // roughly rows touched
+};
+
+// Per-record-type knowledge the planner needs: field names, predicate
+// evaluation, and the index access paths available for a leaf.
+template<typename T>
+class QueryCatalog {
+public:
+    virtual ~QueryCatalog() = default;
+    virtual const GenericManager<T>& Manager() const = 0;
+    virtual bool HasField(const string& field, bool& isText) const = 0;
+    virtual bool Matches(const Query& leaf, const T& item) const = 0;
+    virtual vector<PathOption> Options(const Query& leaf) const = 0;
+    // Ids matching the leaf, ascending.
+    virtual vector<int> Fetch(const Query& leaf, AccessPath path) const = 0;
+
+    // Column-at-a-time evaluation for the planner's scan fallback: sets
+    // *out to the storage positions where leaf holds, or with out null
+    // just says whether that's possible. False for fields without a
+    // column and while the column mirror is off.
+    virtual bool FilterColumns(const Query&, SelectionBitmap*) const { return false; }
+    // The mirror's id column, or null while it is off.
+    virtual const vector<int>* ColumnIds() const { return nullptr; }
+
+    // Inclusive numeric bounds of a range-like leaf.
+    static bool Bounds(const Query& leaf, double& lo, double& hi) {
+        const double inf = numeric_limits<double>::infinity();
+        switch (leaf.op) {
+        case QueryOp::Eq: lo = hi = leaf.lo; return true;
+        case QueryOp::Between: lo = leaf.lo; hi = leaf.hi; return true;
+        case QueryOp::Lt: lo = -inf; hi = nextafter(leaf.lo, -inf); return true;
+        case QueryOp::Le: lo = -inf; hi = leaf.lo; return true;
+        case QueryOp::Gt: lo = nextafter(leaf.lo, inf); hi = inf; return true;
+        case QueryOp::Ge: lo = leaf.lo; hi = inf; return true;
+        default: return false;
+        }
+    }
+
+    static bool IntBounds(const Query& leaf, int& lo, int& hi) {
+        double dlo, dhi;
+        if (!Bounds(leaf, dlo, dhi)) return false;
+        IntRange(dlo, dhi, lo, hi);
+        return true;
+    }
+
+    // The ints within [dlo, dhi]; lo > hi when there are none.
+    static void IntRange(double dlo, double dhi, int& lo, int& hi) {
+        if (isnan(dlo) || isnan(dhi)) {
+            lo = 1;
+            hi = 0;
+            return;
+        }
+        dlo = ceil(dlo);
+        dhi = floor(dhi);
+        lo = dlo < INT_MIN ? INT_MIN : dlo > INT_MAX ? INT_MAX : (int)dlo;
+        hi = dhi > INT_MAX ? INT_MAX : dhi < INT_MIN ? INT_MIN : (int)dhi;
+    }
+
+    // Evaluates a numeric leaf on a column; filter(lo, hi) selects the
+    // positions within an inclusive range, and != is the complement of =.
+    template<typename F>
+    static bool RangeFilter(const Query& leaf, SelectionBitmap* out, F filter) {
+        double lo, hi;
+        if (leaf.op == QueryOp::Ne) lo = hi = leaf.lo;
+        else if (!Bounds(leaf, lo, hi)) return false;
+        if (!out) return true;
+        *out = filter(lo, hi);
+        if (leaf.op == QueryOp::Ne) out->Invert();
+        return true;
+    }
+
+    static SelectionBitmap IntColumnRange(const vector<int>& column, double dlo, double dhi) {
+        int lo, hi;
+        IntRange(dlo, dhi, lo, hi);
+        return FilterIntRange(column, lo, hi);
+    }
+
+    // Flag columns hold 0 or 1.
+    static SelectionBitmap FlagColumnRange(const vector<uint8_t>& column, double dlo, double dhi) {
+        SelectionBitmap selected(column.size());
+        for (uint8_t value : {0, 1}) {
+            if (value >= dlo && value <= dhi) selected.Or(FilterByteEquals(column, value));
+        }
+        return selected;
+    }
+
+    // Index paths keyed by an int or a flag are only offered when the
+    // operand is exactly such a value; anything else (id = 1.5,
+    // repair = 2) can't match and is left to the range index or a scan.
+    static bool ExactInt(double value, int& out) {
+        if (!(value >= INT_MIN && value <= INT_MAX) || value != floor(value)) return false;
+        out = (int)value;
+        return true;
+    }
+
+    static bool ExactFlag(double value, bool& out) {
+        if (value != 0 && value != 1) return false;
+        out = value != 0;
+        return true;
+    }
+
+    static bool CompareNumber(const Query& leaf, double value) {
+        switch (leaf.op) {
+        case QueryOp::Eq: return value == leaf.lo;
+        case QueryOp::Ne: return value != leaf.lo;
+        case QueryOp::Lt: return value < leaf.lo;
+        case QueryOp::Le: return value <= leaf.lo;
+        case QueryOp::Gt: return value > leaf.lo;
+        case QueryOp::Ge: return value >= leaf.lo;
+        case QueryOp::Between: return value >= leaf.lo && value <= leaf.hi;
+        default: return false;
+        }
+    }
+
+    static bool CompareText(const Query& leaf, const string& value) {
+        switch (leaf.op) {
+        case QueryOp::Eq: return value == leaf.text;
+        case QueryOp::Ne: return value != leaf.text;
+        case QueryOp::Contains: return value.find(leaf.text) != string::npos;
+        default: return false;
+        }
+    }
+
+    static vector<int> IdsAt(const vector<int>& idColumn, const vector<uint32_t>& positions) {
+        vector<int> ids;
+        ids.reserve(positions.size());
+        for (uint32_t position : positions) ids.push_back(idColumn[position]);
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    static vector<int> Sorted(vector<int> ids) {
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+};
+
+class PipeQueryCatalog : public QueryCatalog<Pipe> {
+private:
+    const PipeManager& pipes;
+
+public:
+    explicit PipeQueryCatalog(const PipeManager& pm) : pipes(pm) {}
+
+    const GenericManager<Pipe>& Manager() const override { return pipes; }
+
+    bool HasField(const string& field, bool& isText) const override {
+        isText = field == "km";
+        return isText || field == "id" || field == "length" || field == "diameter" || field == "repair";
+    }
+
+    bool Matches(const Query& leaf, const Pipe& p) const override {
+        if (leaf.field == "km") return CompareText(leaf, p.km_mark);
+        if (leaf.field == "id") return CompareNumber(leaf, p.id);
+        if (leaf.field == "length") return CompareNumber(leaf, p.length);
+        if (leaf.field == "diameter") return CompareNumber(leaf, p.diametr);
+        if (leaf.field == "repair") return CompareNumber(leaf, p.repair);
+        return false;
+    }
+
+    vector<PathOption> Options(const Query& leaf) const override {
+        vector<PathOption> options;
+        size_t n = pipes.Size();
+        double lo, hi;
+        int ilo = 0, ihi = -1, key;
+        bool flag;
+        if (leaf.field == "id" && leaf.op == QueryOp::Eq && ExactInt(leaf.lo, key)) {
+            options.push_back({AccessPath::IdLookup, pipes.FindById(key) ? 1u : 0u, 1});
+        }
+        if (leaf.field == "length" && Bounds(leaf, lo, hi)) {
+            size_t k = pipes.LengthIndex().CountRange(lo, hi);
+            options.push_back({AccessPath::RangeIndex, k, 2 * k + 1});
+            if (pipes.Columns()) options.push_back({AccessPath::ColumnScan, k, n / 8 + k});
+        }
+        if (leaf.field == "diameter" && leaf.op == QueryOp::Eq && ExactInt(leaf.lo, key)) {
+            size_t k = pipes.DiameterBitmaps().Get(key).Cardinality();
+            options.push_back({AccessPath::Bitmap, k, k + 1});
+        } else if (leaf.field == "diameter" && IntBounds(leaf, ilo, ihi)) {
+            size_t k = pipes.DiameterIndex().CountRange(ilo, ihi);
+            options.push_back({AccessPath::RangeIndex, k, 2 * k + 1});
+            if (pipes.Columns()) options.push_back({AccessPath::ColumnScan, k, n / 8 + k});
+        }
+        if (leaf.field == "repair" && leaf.op == QueryOp::Eq && ExactFlag(leaf.lo, flag)) {
+            size_t k = pipes.RepairBitmaps().Get(flag).Cardinality();
+            options.push_back({AccessPath::Bitmap, k, k + 1});
+        }
+        if (leaf.field == "km" && (leaf.op == QueryOp::Contains || leaf.op == QueryOp::Eq)) {
+            size_t k = pipes.KmMarkTrigrams().EstimateMatches(leaf.text);
+            if (k != SIZE_MAX) options.push_back({AccessPath::Trigram, k, 2 * k + 1});
+        }
+        return options;
+    }
+
+    vector<int> Fetch(const Query& leaf, AccessPath path) const override {
+        double lo, hi;
+        int ilo = 0, ihi = -1, key;
+        bool flag;
+        switch (path) {
+        case AccessPath::IdLookup:
+            return ExactInt(leaf.lo, key) && pipes.FindById(key) ? vector<int>{key} : vector<int>{};
+        case AccessPath::RangeIndex:
+            if (leaf.field == "length" && Bounds(leaf, lo, hi)) return Sorted(pipes.LengthIndex().Range(lo, hi));
+            IntBounds(leaf, ilo, ihi);
+            return Sorted(pipes.DiameterIndex().Range(ilo, ihi));
+        case AccessPath::Bitmap:
+            if (leaf.field == "repair") return ExactFlag(leaf.lo, flag) ? pipes.RepairBitmaps().Get(flag).ToIds() : vector<int>{};
+            return ExactInt(leaf.lo, key) ? pipes.DiameterBitmaps().Get(key).ToIds() : vector<int>{};
+        case AccessPath::Trigram: {
+            vector<int> ids;
+            pipes.KmMarkTrigrams().Find(pipes, leaf.text, ids);
+            if (leaf.op == QueryOp::Eq) {
+                ids.erase(remove_if(ids.begin(), ids.end(),
+                    [&](int id) { return pipes.FindById(id)->km_mark != leaf.text; }), ids.end());
+            }
+            return ids;
+        }
+        case AccessPath::ColumnScan: {
+            const PipeColumns& columns = *pipes.Columns();
+            if (leaf.field == "length" && Bounds(leaf, lo, hi)) {
+                return IdsAt(columns.id, FilterDoubleRange(columns.length, lo, hi).ToPositions());
+            }
+            IntBounds(leaf, ilo, ihi);
+            return IdsAt(columns.id, FilterIntRange(columns.diametr, ilo, ihi).ToPositions());
+        }
+        default:
+            return {};
+        }
+    }
+
+    bool FilterColumns(const Query& leaf, SelectionBitmap* out) const override {
+        const PipeColumns* columns = pipes.Columns();
+        if (!columns) return false;
+        if (leaf.field == "id") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return IntColumnRange(columns->id, lo, hi); });
+        }
+        if (leaf.field == "length") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return FilterDoubleRange(columns->length, lo, hi); });
+        }
+        if (leaf.field == "diameter") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return IntColumnRange(columns->diametr, lo, hi); });
+        }
+        if (leaf.field == "repair") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return FlagColumnRange(columns->repair, lo, hi); });
+        }
+        return false;
+    }
+
+    const vector<int>* ColumnIds() const override { return pipes.Columns() ? &pipes.Columns()->id : nullptr; }
+};
+
+class CompressQueryCatalog : public QueryCatalog<Compress> {
+private:
+    const CompressManager& stations;
+
+public:
+    explicit CompressQueryCatalog(const CompressManager& cm) : stations(cm) {}
+
+    const GenericManager<Compress>& Manager() const override { return stations; }
+
+    bool HasField(const string& field, bool& isText) const override {
+        isText = field == "name" || field == "class";
+        return isText || field == "id" || field == "workshops" || field == "working" ||
+               field == "percent" || field == "active";
+    }
+
+    bool Matches(const Query& leaf, const Compress& c) const override {
+        if (leaf.field == "name") return CompareText(leaf, c.name);
+        if (leaf.field == "class") return CompareText(leaf, c.classification);
+        if (leaf.field == "id") return CompareNumber(leaf, c.id);
+        if (leaf.field == "workshops") return CompareNumber(leaf, c.workshop_count);
+        if (leaf.field == "working") return CompareNumber(leaf, c.workshop_working);
+        if (leaf.field == "active") return CompareNumber(leaf, c.working);
+        if (leaf.field == "percent") {
+            double percentage;
+            return CompressManager::UtilizationKey(c, percentage) && CompareNumber(leaf, percentage);
+        }
+        return false;
+    }
+
+    vector<PathOption> Options(const Query& leaf) const override {
+        vector<PathOption> options;
+        size_t n = stations.Size();
+        double lo, hi;
+        int ilo = 0, ihi = -1, key;
+        bool flag;
+        if (leaf.field == "id" && leaf.op == QueryOp::Eq && ExactInt(leaf.lo, key)) {
+            options.push_back({AccessPath::IdLookup, stations.FindById(key) ? 1u : 0u, 1});
+        }
+        if (leaf.field == "working" && IntBounds(leaf, ilo, ihi)) {
+            size_t k = stations.WorkingIndex().CountRange(ilo, ihi);
+            options.push_back({AccessPath::RangeIndex, k, 2 * k + 1});
+            if (stations.Columns()) options.push_back({AccessPath::ColumnScan, k, n / 8 + k});
+        }
+        if (leaf.field == "percent" && Bounds(leaf, lo, hi)) {
+            size_t k = stations.UtilizationIndex().CountRange(lo, hi);
+            options.push_back({AccessPath::RangeIndex, k, 2 * k + 1});
+            if (stations.Columns()) options.push_back({AccessPath::ColumnScan, k, n / 4 + k});
+        }
+        if (leaf.field == "workshops" && IntBounds(leaf, ilo, ihi) && stations.Columns()) {
+            options.push_back({AccessPath::ColumnScan, n / 3, n / 8 + n / 3});
+        }
+        if (leaf.field == "active" && leaf.op == QueryOp::Eq && ExactFlag(leaf.lo, flag)) {
+            size_t k = stations.StatusBitmaps().Get(flag).Cardinality();
+            options.push_back({AccessPath::Bitmap, k, k + 1});
+        }
+        if (leaf.field == "class" && (leaf.op == QueryOp::Eq || leaf.op == QueryOp::Contains)) {
+            const auto& bitmaps = stations.ClassificationBitmaps();
+            size_t k = leaf.op == QueryOp::Eq ? bitmaps.Get(leaf.text).Cardinality() : n / 2;
+            options.push_back({AccessPath::Bitmap, k, k + bitmaps.DistinctValues()});
+        }
+        if (leaf.field == "name" && (leaf.op == QueryOp::Contains || leaf.op == QueryOp::Eq)) {
+            size_t k = stations.NameTrigrams().EstimateMatches(leaf.text);
+            if (k != SIZE_MAX) options.push_back({AccessPath::Trigram, k, 2 * k + 1});
+        }
+        return options;
+    }
+
+    vector<int> Fetch(const Query& leaf, AccessPath path) const override {
+        double lo, hi;
+        int ilo = 0, ihi = -1, key;
+        bool flag;
+        switch (path) {
+        case AccessPath::IdLookup:
+            return ExactInt(leaf.lo, key) && stations.FindById(key) ? vector<int>{key} : vector<int>{};
+        case AccessPath::RangeIndex:
+            if (leaf.field == "percent" && Bounds(leaf, lo, hi)) return Sorted(stations.UtilizationIndex().Range(lo, hi));
+            IntBounds(leaf, ilo, ihi);
+            return Sorted(stations.WorkingIndex().Range(ilo, ihi));
+        case AccessPath::Bitmap:
+            if (leaf.field == "active") return ExactFlag(leaf.lo, flag) ? stations.StatusBitmaps().Get(flag).ToIds() : vector<int>{};
+            if (leaf.op == QueryOp::Eq) return stations.ClassificationBitmaps().Get(leaf.text).ToIds();
+            return stations.ClassificationBitmaps().Union(
+                [&leaf](const string& c) { return c.find(leaf.text) != string::npos; }).ToIds();
+        case AccessPath::Trigram: {
+            vector<int> ids;
+            stations.NameTrigrams().Find(stations, leaf.text, ids);
+            if (leaf.op == QueryOp::Eq) {
+                ids.erase(remove_if(ids.begin(), ids.end(),
+                    [&](int id) { return stations.FindById(id)->name != leaf.text; }), ids.end());
+            }
+            return ids;
+        }
+        case AccessPath::ColumnScan: {
+            const CompressColumns& columns = *stations.Columns();
+            if (leaf.field == "percent" && Bounds(leaf, lo, hi)) {
+                return IdsAt(columns.id,
+                    FilterPercentRange(columns.workshop_working, columns.workshop_count, lo, hi).ToPositions());
+            }
+            IntBounds(leaf, ilo, ihi);
+            const vector<int>& column = leaf.field == "workshops" ? columns.workshop_count : columns.workshop_working;
+            return IdsAt(columns.id, FilterIntRange(column, ilo, ihi).ToPositions());
+        }
+        default:
+            return {};
+        }
+    }
+
+    bool FilterColumns(const Query& leaf, SelectionBitmap* out) const override {
+        const CompressColumns* columns = stations.Columns();
+        if (!columns) return false;
+        if (leaf.field == "id") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return IntColumnRange(columns->id, lo, hi); });
+        }
+        if (leaf.field == "workshops") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return IntColumnRange(columns->workshop_count, lo, hi); });
+        }
+        if (leaf.field == "working") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return IntColumnRange(columns->workshop_working, lo, hi); });
+        }
+        if (leaf.field == "active") {
+            return RangeFilter(leaf, out, [&](double lo, double hi) { return FlagColumnRange(columns->working, lo, hi); });
+        }
+        // Stations without workshops have no percentage, so != can't be
+        // the complement of =; that case is left to the row scan.
+        if (leaf.field == "percent" && leaf.op != QueryOp::Ne) {
+            return RangeFilter(leaf, out, [&](double lo, double hi) {
+                return FilterPercentRange(columns->workshop_working, columns->workshop_count, lo, hi);
+            });
+        }
+        return false;
+    }
+
+    const vector<int>* ColumnIds() const override { return stations.Columns() ? &stations.Columns()->id : nullptr; }
+};
+
+// Picks an access path per node by estimated cost and runs the plan.
+// AND is driven by its cheapest indexed child, the rest are checked on
+// the driver's hits; OR unions its children when all are indexed;
+// anything else falls back to a scan. The scan runs column at a time on
+// the manager's column mirror when every leaf under it has a column,
+// and over the rows otherwise.
+template<typename T>
+class QueryPlanner {
+public:
+    struct PlanNode {
+        const Query* query = nullptr;
+        AccessPath path = AccessPath::Scan;
+        size_t estimate = 0;
+        size_t cost = 0;
+        long long actual = -1;     // -1: checked as a residual filter only
+        int driver = -1;           // AND: index of the driving child
+        bool columnar = false;     // a scan that runs on the column mirror
+        vector<PlanNode> children;
+    };
+
+private:
+    const QueryCatalog<T>& catalog;
+
+    bool Evaluate(const Query& q, const T& item) const {
+        switch (q.kind) {
+        case Query::Kind::Leaf: return catalog.Matches(q, item);
+        case Query::Kind::Not: return !Evaluate(q.children[0], item);
+        case Query::Kind::And:
+            for (const auto& child : q.children) {
+                if (!Evaluate(child, item)) return false;
+            }
+            return true;
+        default:
+            for (const auto& child : q.children) {
+                if (Evaluate(child, item)) return true;
+            }
+            return false;
+        }
+    }
+
+    // Positions matching q, combined leaf by leaf; with out null, only
+    // whether every leaf can be evaluated on the columns.
+    bool ScanColumns(const Query& q, SelectionBitmap* out) const {
+        if (q.kind == Query::Kind::Leaf) return catalog.FilterColumns(q, out);
+        if (!out) {
+            for (const auto& child : q.children) {
+                if (!ScanColumns(child, nullptr)) return false;
+            }
+            return true;
+        }
+        ScanColumns(q.children[0], out);
+        if (q.kind == Query::Kind::Not) {
+            out->Invert();
+            return true;
+        }
+        for (size_t i = 1; i < q.children.size(); i++) {
+            SelectionBitmap part;
+            ScanColumns(q.children[i], &part);
+            if (q.kind == Query::Kind::And) out->And(part);
+            else out->Or(part);
+        }
+        return true;
+    }
+
+    bool ColumnScannable(const Query& q) const { return catalog.ColumnIds() && ScanColumns(q, nullptr); }
+
+    vector<int> ScanRows(const Query& q) const {
+        if (ColumnScannable(q)) {
+            SelectionBitmap selected;
+            ScanColumns(q, &selected);
+            return QueryCatalog<T>::IdsAt(*catalog.ColumnIds(), selected.ToPositions());
+        }
+        vector<int> ids;
+        catalog.Manager().ForEach([&](const T& item) {
+            if (Evaluate(q, item)) ids.push_back(item.id);
+        });
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    static size_t ScanEstimate(const Query& q, size_t n) {
+        switch (q.op) {
+        case QueryOp::Eq: return n / 10;
+        case QueryOp::Ne: return n - n / 10;
+        default: return n / 3;
+        }
+    }
+
+    PlanNode PlanNodeFor(const Query& q) const {
+        size_t n = catalog.Manager().Size();
+        PlanNode node;
+        node.query = &q;
+        node.cost = n;
+        node.columnar = ColumnScannable(q);
+
+        if (q.kind == Query::Kind::Leaf) {
+            node.estimate = ScanEstimate(q, n);
+            for (const PathOption& option : catalog.Options(q)) {
+                if (option.cost < node.cost) {
+                    node.path = option.path;
+                    node.cost = option.cost;
+                    node.estimate = option.estimate;
+                }
+            }
+            return node;
+        }
+
+        for (const auto& child : q.children) node.children.push_back(PlanNodeFor(child));
+
+        if (q.kind == Query::Kind::Not) {
+            node.estimate = n - min(n, node.children[0].estimate);
+        } else if (q.kind == Query::Kind::And) {
+            node.estimate = n;
+            for (size_t i = 0; i < node.children.size(); i++) {
+                const PlanNode& child = node.children[i];
+                node.estimate = min(node.estimate, child.estimate);
+                bool indexed = child.path != AccessPath::Scan;
+                if (indexed && child.cost + child.estimate < node.cost) {
+                    node.driver = (int)i;
+                    node.cost = child.cost + child.estimate;
+                }
+            }
+            if (node.driver >= 0) node.path = node.children[node.driver].path;
+        } else {
+            size_t estimate = 0, cost = 0;
+            bool allIndexed = true;
+            for (const auto& child : node.children) {
+                estimate += child.estimate;
+                cost += child.cost;
+                allIndexed = allIndexed && child.path != AccessPath::Scan;
+            }
+            node.estimate = min(n, estimate);
+            if (allIndexed && cost < n) {
+                node.path = AccessPath::IndexUnion;
+                node.cost = cost;
+            }
+        }
+        return node;
+    }
+
+    vector<int> Run(PlanNode& node) const {
+        const Query& q = *node.query;
+        vector<int> ids;
+
+        if (q.kind == Query::Kind::Leaf) {
+            ids = node.path == AccessPath::Scan ? ScanRows(q) : catalog.Fetch(q, node.path);
+        } else if (q.kind == Query::Kind::And && node.driver >= 0) {
+            ids = Run(node.children[node.driver]);
+            const auto& manager = catalog.Manager();
+            ids.erase(remove_if(ids.begin(), ids.end(), [&](int id) {
+                const T* item = manager.FindById(id);
+                if (!item) return true;
+                for (size_t i = 0; i < q.children.size(); i++) {
+                    if ((int)i != node.driver && !Evaluate(q.children[i], *item)) return true;
+                }
+                return false;
+            }), ids.end());
+        } else if (q.kind == Query::Kind::Or && node.path != AccessPath::Scan) {
+            for (auto& child : node.children) {
+                vector<int> part = Run(child);
+                vector<int> merged;
+                set_union(ids.begin(), ids.end(), part.begin(), part.end(), back_inserter(merged));
+                ids.swap(merged);
+            }
+        } else {
+            ids = ScanRows(q);
+        }
+
+        node.actual = (long long)ids.size();
+        return ids;
+    }
+
+    static void Describe(const PlanNode& node, int depth, const string& role, stringstream& out) {
+        const Query& q = *node.query;
+        string label;
+        string scan = node.columnar ? "(column scan)" : "(scan)";
+        if (q.kind == Query::Kind::Leaf) {
+            AccessPath shown = node.path == AccessPath::Scan && node.columnar ? AccessPath::ColumnScan : node.path;
+            label = string(AccessPathName(shown)) + " " + q.ToString();
+        } else if (q.kind == Query::Kind::And) {
+            label = node.driver >= 0 ? "AND (driven by child " + to_string(node.driver + 1) + ")" : "AND " + scan;
+        } else if (q.kind == Query::Kind::Or) {
+            label = node.path == AccessPath::Scan ? "OR " + scan : "OR (index union)";
+        } else {
+            label = "NOT " + scan;
+        }
+
+        out << string(depth * 2, ' ') << role << label << "  est " << node.estimate << " rows, actual ";
+        if (node.actual >= 0) out << node.actual;
+        else out << "-";
+        out << "\n";
+
+        for (size_t i = 0; i < node.children.size(); i++) {
+            string childRole;
+            if (q.kind == Query::Kind::And && node.driver >= 0) {
+                childRole = (int)i == node.driver ? "[driver] " : "[filter] ";
+            }
+            Describe(node.children[i], depth + 1, childRole, out);
+        }
+    }
+
+    bool Validate(const Query& q, string& error) const {
+        if (q.kind != Query::Kind::Leaf) {
+            for (const auto& child : q.children) {
+                if (!Validate(child, error)) return false;
+            }
+            return true;
+        }
+        bool isText;
+        if (!catalog.HasField(q.field, isText)) {
+            error = "unknown field '" + q.field + "'";
+            return false;
+        }
+        bool textOp = q.op == QueryOp::Eq || q.op == QueryOp::Ne || q.op == QueryOp::Contains;
+        if (isText && !textOp) {
+            error = "field '" + q.field + "' supports only =, != and ~";
+            return false;
+        }
+        if (!isText && !q.numeric) {
+            error = "field '" + q.field + "' needs a number";
+            return false;
+        }
+        return true;
+    }
+
+public:
+    explicit QueryPlanner(const QueryCatalog<T>& c) : catalog(c) {}
+
+    bool Check(const Query& q, string& error) const { return Validate(q, error); }
+
+    PlanNode Plan(const Query& q) const { return PlanNodeFor(q); }
+
+    vector<int> Execute(PlanNode& plan) const { return Run(plan); }
+
+    static string Explain(const PlanNode& plan) {
+        stringstream out;
+        Describe(plan, 0, "", out);
+        return out.str();
+    }
+};
+
+#endif
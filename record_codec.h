@@ -0,0 +1,92 @@
+#ifndef RECORD_CODEC_H
+#define RECORD_CODEC_H
+
+#include "structs.h"
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Compact little-endian encoding of one record, shared by the journal
+// and the paged storage:
+//
+//   Pipe      i32 id, i32 diameter, f64 length, u8 repair, str km mark
+//   Compress  i32 id, i32 workshops, i32 working, u8 active, str name,
+//             str classification
+//
+// where str is a u32 length followed by the bytes.
+
+template<typename N>
+inline void PutValue(string& out, N value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void PutString(string& out, const string& s) {
+    PutValue(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+template<typename N>
+inline bool GetValue(const char*& p, const char* end, N& value) {
+    if (size_t(end - p) < sizeof(value)) return false;
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+inline bool GetString(const char*& p, const char* end, string& s) {
+    uint32_t length;
+    if (!GetValue(p, end, length) || length > size_t(end - p)) return false;
+    s.assign(p, length);
+    p += length;
+    return true;
+}
+
+inline void EncodeRecord(string& out, const Pipe& pipe) {
+    PutValue(out, static_cast<int32_t>(pipe.id));
+    PutValue(out, static_cast<int32_t>(pipe.diametr));
+    PutValue(out, pipe.length);
+    PutValue(out, static_cast<uint8_t>(pipe.repair ? 1 : 0));
+    PutString(out, pipe.km_mark);
+}
+
+inline void EncodeRecord(string& out, const Compress& station) {
+    PutValue(out, static_cast<int32_t>(station.id));
+    PutValue(out, static_cast<int32_t>(station.workshop_count));
+    PutValue(out, static_cast<int32_t>(station.workshop_working));
+    PutValue(out, static_cast<uint8_t>(station.working ? 1 : 0));
+    PutString(out, station.name);
+    PutString(out, station.classification);
+}
+
+// Decodes a record that fills [p, end) exactly.
+inline bool DecodeRecord(const char* p, const char* end, Pipe& pipe) {
+    int32_t id, diameter;
+    uint8_t repair;
+    if (!GetValue(p, end, id) || !GetValue(p, end, diameter) || !GetValue(p, end, pipe.length) ||
+        !GetValue(p, end, repair) || !GetString(p, end, pipe.km_mark)) {
+        return false;
+    }
+    pipe.id = id;
+    pipe.diametr = diameter;
+    pipe.repair = repair != 0;
+    return p == end;
+}
+
+inline bool DecodeRecord(const char* p, const char* end, Compress& station) {
+    int32_t id, count, working;
+    uint8_t active;
+    if (!GetValue(p, end, id) || !GetValue(p, end, count) || !GetValue(p, end, working) ||
+        !GetValue(p, end, active) || !GetString(p, end, station.name) ||
+        !GetString(p, end, station.classification)) {
+        return false;
+    }
+    station.id = id;
+    station.workshop_count = count;
+    station.workshop_working = working;
+    station.working = active != 0;
+    return p == end;
+}
+
+#endif
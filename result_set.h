@@ -0,0 +1,44 @@
+#ifndef RESULT_SET_H
+#define RESULT_SET_H
+
+#include "generic_manager.h"
+#include "slot_map.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// Search hits as handles into the manager's storage: 8 bytes per hit,
+// records are resolved only when read. A hit whose record was deleted
+// since the search resolves to nullptr.
+template<typename T>
+class ResultSet {
+private:
+    const GenericManager<T>* manager;
+    vector<Handle> handles;
+
+public:
+    explicit ResultSet(const GenericManager<T>& m) : manager(&m) {}
+
+    void Add(Handle h) { handles.push_back(h); }
+    void Reserve(size_t n) { handles.reserve(n); }
+
+    size_t Size() const { return handles.size(); }
+    bool Empty() const { return handles.empty(); }
+
+    Handle HandleAt(size_t i) const { return handles[i]; }
+    const T* Get(size_t i) const { return manager->Get(handles[i]); }
+
+    template<typename F>
+    void ForEach(F f) const {
+        for (Handle h : handles) {
+            if (const T* item = manager->Get(h)) f(*item);
+        }
+    }
+
+    size_t PageCount(size_t pageSize) const { return (handles.size() + pageSize - 1) / pageSize; }
+    size_t PageBegin(size_t page, size_t pageSize) const { return min(handles.size(), page * pageSize); }
+    size_t PageEnd(size_t page, size_t pageSize) const { return min(handles.size(), (page + 1) * pageSize); }
+};
+
+#endif
@@ -3,10 +3,14 @@
 
 #include "structs.h"
 #include "logger.h"
+#include "pipe_manager.h"
+#include "compress_manager.h"
+#include "columns.h"
+#include "query.h"
+#include "result_set.h"
+#include "predicates.h"
+#include "thread_pool.h"
 #include <vector>
-#include <sstream>
-#include <iomanip>
-#include <functional>
 
 using namespace std;
 
@@ -14,109 +18,240 @@ template<typename T>
 class GenericSearchEngine {
 protected:
     Logger& logger;
+    ExecutionMode mode = ExecutionMode::Parallel;
+    size_t parallelThreshold = DEFAULT_PARALLEL_THRESHOLD;
+    ThreadPool* pool = nullptr;
+
+    // Records per parallel task: about 256 KB of T, so one chunk stays
+    // in a core's L2 while it is filtered.
+    static constexpr size_t CHUNK_BYTES = 256 * 1024;
+    static constexpr size_t MIN_CHUNK_ITEMS = 1024;
+
+    static size_t ChunkItems() { return max(MIN_CHUNK_ITEMS, CHUNK_BYTES / sizeof(T)); }
+
+    template<typename Pred>
+    void ScanSerial(const GenericManager<T>& manager, const Pred& condition, ResultSet<T>& results) {
+        manager.ForEachInRange(0, manager.Size(), [&](const T& item, size_t i) {
+            if (condition(item)) {
+                results.Add(manager.HandleAt(i));
+            }
+        });
+    }
+
+    // Each task filters one chunk into its own position list; lists are
+    // appended in chunk order, so hits come out in storage order exactly
+    // as in the serial scan.
+    template<typename Pred>
+    void ScanParallel(const GenericManager<T>& manager, const Pred& condition, ResultSet<T>& results) {
+        size_t size = manager.Size();
+        size_t chunk = ChunkItems();
+        size_t chunks = (size + chunk - 1) / chunk;
+        vector<vector<uint32_t>> hits(chunks);
+
+        ThreadPool& workers = pool ? *pool : ThreadPool::Shared();
+        workers.ParallelFor(chunks, [&](size_t c) {
+            size_t begin = c * chunk;
+            manager.ForEachInRange(begin, min(size, begin + chunk), [&](const T& item, size_t i) {
+                if (condition(item)) hits[c].push_back(static_cast<uint32_t>(i));
+            });
+        });
+
+        size_t total = 0;
+        for (const auto& h : hits) total += h.size();
+        results.Reserve(total);
+        for (const auto& h : hits) {
+            for (uint32_t i : h) results.Add(manager.HandleAt(i));
+        }
+    }
+
+    void LogFound(const string& description, const ResultSet<T>& results) {
+        LOG_EVENT(logger, LogEvent::SearchResult, description, results.Size());
+    }
 
 public:
+    // Below this many records a scan stays on the calling thread.
+    static constexpr size_t DEFAULT_PARALLEL_THRESHOLD = 200000;
+
     GenericSearchEngine(Logger& log) : logger(log) {}
 
     virtual ~GenericSearchEngine() = default;
 
-    vector<T> SearchById(const vector<T>& items, int id) {
-        vector<T> results;
-        for (const auto& item : items) {
-            if (item.id == id) {
-                results.push_back(item);
-                break;
-            }
+    void SetExecutionMode(ExecutionMode m) { mode = m; }
+    ExecutionMode GetExecutionMode() const { return mode; }
+    void SetParallelThreshold(size_t records) { parallelThreshold = records; }
+    // Defaults to ThreadPool::Shared().
+    void SetThreadPool(ThreadPool& p) { pool = &p; }
+
+    ResultSet<T> SearchById(const GenericManager<T>& manager, int id) {
+        ResultSet<T> results(manager);
+        Handle h = manager.HandleOf(id);
+        if (manager.Get(h)) {
+            results.Add(h);
         }
-        logger.Log("SEARCH BY ID - ID: " + to_string(id) + (results.empty() ? " - No results" : " - Found"));
+        LOG_TEXT(logger, LogLevel::Debug, LogCategory::Search,
+                 "SEARCH BY ID - ID: " + to_string(id) + (results.Empty() ? " - No results" : " - Found"));
         return results;
     }
 
-    vector<T> SearchByCondition(const vector<T>& items, function<bool(const T&)> condition, const string& description) {
-        vector<T> results;
-        for (const auto& item : items) {
-            if (condition(item)) {
-                results.push_back(item);
-            }
+    // The predicate is a template parameter so lambdas and predicates.h
+    // combinators inline into the loop; a std::function still works. In
+    // parallel mode the predicate is called from several threads at once
+    // and must not modify shared state.
+    template<typename Pred>
+    ResultSet<T> SearchByCondition(const GenericManager<T>& manager, Pred condition, const string& description) {
+        ResultSet<T> results(manager);
+        if (mode == ExecutionMode::Parallel && manager.Size() >= parallelThreshold) {
+            ScanParallel(manager, condition, results);
+        } else {
+            ScanSerial(manager, condition, results);
+        }
+        LogFound(description, results);
+        return results;
+    }
+
+    // Wraps the ids returned by an index lookup.
+    ResultSet<T> SearchByIds(const GenericManager<T>& manager, const vector<int>& ids, const string& description) {
+        ResultSet<T> results(manager);
+        results.Reserve(ids.size());
+        for (int id : ids) {
+            Handle h = manager.HandleOf(id);
+            if (manager.Get(h)) results.Add(h);
         }
-        stringstream ss;
-        ss << description << " - Found: " << results.size();
-        logger.Log(ss.str());
+        LogFound(description, results);
         return results;
     }
+
+    // Plans and runs a composite query; on an invalid query returns false
+    // with the reason in report, otherwise report holds the explain output.
+    bool SearchByQuery(const QueryCatalog<T>& catalog, const Query& query, ResultSet<T>& results,
+                       string& report, const string& description) {
+        QueryPlanner<T> planner(catalog);
+        if (!planner.Check(query, report)) {
+            logger.Log(LogLevel::Error, LogCategory::Search, "ERROR: Invalid query - " + report);
+            return false;
+        }
+        auto plan = planner.Plan(query);
+        vector<int> ids = planner.Execute(plan);
+        report = planner.Explain(plan);
+        results = SearchByIds(catalog.Manager(), ids, description);
+        return true;
+    }
 };
 
 class SearchEngine : public GenericSearchEngine<Pipe>, public GenericSearchEngine<Compress> {
+private:
+    // Descriptions only feed the SearchResult log entry; skip building
+    // them when it is filtered out.
+    bool LogsSearches() const { return GenericSearchEngine<Pipe>::logger.Enabled(LogEvent::SearchResult); }
+
 public:
     SearchEngine(Logger& log) : GenericSearchEngine<Pipe>(log), GenericSearchEngine<Compress>(log) {}
 
-    vector<Pipe> SearchPipesById(const vector<Pipe>& pipes, int id) {
+    void SetExecutionMode(ExecutionMode m) {
+        GenericSearchEngine<Pipe>::SetExecutionMode(m);
+        GenericSearchEngine<Compress>::SetExecutionMode(m);
+    }
+
+    ExecutionMode GetExecutionMode() const { return GenericSearchEngine<Pipe>::GetExecutionMode(); }
+
+    void SetParallelThreshold(size_t records) {
+        GenericSearchEngine<Pipe>::SetParallelThreshold(records);
+        GenericSearchEngine<Compress>::SetParallelThreshold(records);
+    }
+
+    void SetThreadPool(ThreadPool& p) {
+        GenericSearchEngine<Pipe>::SetThreadPool(p);
+        GenericSearchEngine<Compress>::SetThreadPool(p);
+    }
+
+    // Ad-hoc multi-criterion filter, e.g.
+    // SearchPipesWhere(pipes, AllOf(FieldEquals(&Pipe::repair, true), FieldBetween(&Pipe::length, 1.0, 5.0)), "...")
+    template<typename Pred>
+    ResultSet<Pipe> SearchPipesWhere(const PipeManager& pipes, Pred condition, const string& description) {
+        return GenericSearchEngine<Pipe>::SearchByCondition(pipes, condition, description);
+    }
+
+    template<typename Pred>
+    ResultSet<Compress> SearchCompressWhere(const CompressManager& stations, Pred condition, const string& description) {
+        return GenericSearchEngine<Compress>::SearchByCondition(stations, condition, description);
+    }
+
+    ResultSet<Pipe> SearchPipesById(const PipeManager& pipes, int id) {
         return GenericSearchEngine<Pipe>::SearchById(pipes, id);
     }
 
-    vector<Pipe> SearchPipesByKmMark(const vector<Pipe>& pipes, const string& kmMark) {
-        return GenericSearchEngine<Pipe>::SearchByCondition(pipes,
-            [&kmMark](const Pipe& p) { return p.km_mark.find(kmMark) != string::npos; },
-            "SEARCH PIPE BY KM MARK - Query: '" + kmMark + "'");
+    ResultSet<Pipe> SearchPipesByKmMark(const PipeManager& pipes, const string& kmMark) {
+        string description = LogsSearches() ? "SEARCH PIPE BY KM MARK - Query: '" + kmMark + "'" : string();
+        vector<int> ids;
+        if (pipes.KmMarkTrigrams().Find(pipes, kmMark, ids)) {
+            return GenericSearchEngine<Pipe>::SearchByIds(pipes, ids, description);
+        }
+        return GenericSearchEngine<Pipe>::SearchByCondition(pipes, FieldContains(&Pipe::km_mark, kmMark), description);
+    }
+
+    ResultSet<Pipe> SearchPipesByDiameter(const PipeManager& pipes, int diameter) {
+        string description = LogsSearches() ? "SEARCH PIPE BY DIAMETER - Diameter: " + to_string(diameter) + " mm" : string();
+        return GenericSearchEngine<Pipe>::SearchByIds(pipes, pipes.DiameterBitmaps().Get(diameter).ToIds(), description);
     }
 
-    vector<Pipe> SearchPipesByDiameter(const vector<Pipe>& pipes, int diameter) {
-        return GenericSearchEngine<Pipe>::SearchByCondition(pipes,
-            [diameter](const Pipe& p) { return p.diametr == diameter; },
-            "SEARCH PIPE BY DIAMETER - Diameter: " + to_string(diameter) + " mm");
+    ResultSet<Pipe> SearchPipesByRepair(const PipeManager& pipes, bool repair) {
+        string description = LogsSearches() ? "SEARCH PIPE BY REPAIR STATUS - Status: " + string(repair ? "On repair" : "Not on repair") : string();
+        return GenericSearchEngine<Pipe>::SearchByIds(pipes, pipes.RepairBitmaps().Get(repair).ToIds(), description);
     }
 
-    vector<Pipe> SearchPipesByRepair(const vector<Pipe>& pipes, bool repair) {
-        return GenericSearchEngine<Pipe>::SearchByCondition(pipes,
-            [repair](const Pipe& p) { return p.repair == repair; },
-            "SEARCH PIPE BY REPAIR STATUS - Status: " + string(repair ? "On repair" : "Not on repair"));
+    ResultSet<Pipe> SearchPipesByLength(const PipeManager& pipes, double minLength, double maxLength) {
+        string description = LogsSearches() ? "SEARCH PIPE BY LENGTH - Range: " + to_string(minLength) + "-" + to_string(maxLength) + " km" : string();
+        return GenericSearchEngine<Pipe>::SearchByIds(pipes, pipes.LengthIndex().Range(minLength, maxLength), description);
     }
 
-    vector<Pipe> SearchPipesByLength(const vector<Pipe>& pipes, double minLength, double maxLength) {
-        return GenericSearchEngine<Pipe>::SearchByCondition(pipes,
-            [minLength, maxLength](const Pipe& p) { return p.length >= minLength && p.length <= maxLength; },
-            "SEARCH PIPE BY LENGTH - Range: " + to_string(minLength) + "-" + to_string(maxLength) + " km");
+    bool SearchPipesByQuery(const PipeManager& pipes, const Query& query, ResultSet<Pipe>& results, string& report) {
+        return GenericSearchEngine<Pipe>::SearchByQuery(PipeQueryCatalog(pipes), query, results, report,
+            LogsSearches() ? "SEARCH PIPE BY QUERY - Query: '" + query.ToString() + "'" : string());
     }
 
-    vector<Compress> SearchCompressById(const vector<Compress>& stations, int id) {
+    ResultSet<Compress> SearchCompressById(const CompressManager& stations, int id) {
         return GenericSearchEngine<Compress>::SearchById(stations, id);
     }
 
-    vector<Compress> SearchCompressByName(const vector<Compress>& stations, const string& name) {
-        return GenericSearchEngine<Compress>::SearchByCondition(stations,
-            [&name](const Compress& c) { return c.name.find(name) != string::npos; },
-            "SEARCH CS BY NAME - Query: '" + name + "'");
+    ResultSet<Compress> SearchCompressByName(const CompressManager& stations, const string& name) {
+        string description = LogsSearches() ? "SEARCH CS BY NAME - Query: '" + name + "'" : string();
+        vector<int> ids;
+        if (stations.NameTrigrams().Find(stations, name, ids)) {
+            return GenericSearchEngine<Compress>::SearchByIds(stations, ids, description);
+        }
+        return GenericSearchEngine<Compress>::SearchByCondition(stations, FieldContains(&Compress::name, name), description);
+    }
+
+    ResultSet<Compress> SearchCompressByClassification(const CompressManager& stations, const string& classification) {
+        // Few distinct classes: match the query against each class once
+        // and union their bitmaps instead of testing every station.
+        RoaringBitmap matches = stations.ClassificationBitmaps().Union(
+            [&classification](const string& c) { return c.find(classification) != string::npos; });
+        return GenericSearchEngine<Compress>::SearchByIds(stations, matches.ToIds(),
+            LogsSearches() ? "SEARCH CS BY CLASSIFICATION - Query: '" + classification + "'" : string());
     }
 
-    vector<Compress> SearchCompressByClassification(const vector<Compress>& stations, const string& classification) {
-        return GenericSearchEngine<Compress>::SearchByCondition(stations,
-            [&classification](const Compress& c) { return c.classification.find(classification) != string::npos; },
-            "SEARCH CS BY CLASSIFICATION - Query: '" + classification + "'");
+    ResultSet<Compress> SearchCompressByStatus(const CompressManager& stations, bool working) {
+        string description = LogsSearches() ? "SEARCH CS BY STATUS - Status: " + string(working ? "Working" : "Not working") : string();
+        return GenericSearchEngine<Compress>::SearchByIds(stations, stations.StatusBitmaps().Get(working).ToIds(), description);
     }
 
-    vector<Compress> SearchCompressByStatus(const vector<Compress>& stations, bool working) {
-        return GenericSearchEngine<Compress>::SearchByCondition(stations,
-            [working](const Compress& c) { return c.working == working; },
-            "SEARCH CS BY STATUS - Status: " + string(working ? "Working" : "Not working"));
+    ResultSet<Compress> SearchCompressByWorkshopPercentage(const CompressManager& stations, double minPercent, double maxPercent) {
+        string description = LogsSearches() ? "SEARCH CS BY WORKSHOP PERCENTAGE - Range: " + to_string(minPercent) + "%-" + to_string(maxPercent) + "%" : string();
+        return GenericSearchEngine<Compress>::SearchByIds(stations,
+            stations.UtilizationIndex().Range(minPercent, maxPercent), description);
     }
 
-    vector<Compress> SearchCompressByWorkshopPercentage(const vector<Compress>& stations, double minPercent, double maxPercent) {
-        return GenericSearchEngine<Compress>::SearchByCondition(stations,
-            [minPercent, maxPercent](const Compress& c) { 
-                if (c.workshop_count > 0) {
-                    double percentage = (double)c.workshop_working / c.workshop_count * 100;
-                    return percentage >= minPercent && percentage <= maxPercent;
-                }
-                return false;
-            },
-            "SEARCH CS BY WORKSHOP PERCENTAGE - Range: " + to_string(minPercent) + "%-" + to_string(maxPercent) + "%");
+    ResultSet<Compress> SearchCompressByWorkshopCount(const CompressManager& stations, int minCount, int maxCount) {
+        string description = LogsSearches() ? "SEARCH CS BY WORKING WORKSHOPS - Range: " + to_string(minCount) + "-" + to_string(maxCount) : string();
+        return GenericSearchEngine<Compress>::SearchByIds(stations,
+            stations.WorkingIndex().Range(minCount, maxCount), description);
     }
 
-    vector<Compress> SearchCompressByWorkshopCount(const vector<Compress>& stations, int minCount, int maxCount) {
-        return GenericSearchEngine<Compress>::SearchByCondition(stations,
-            [minCount, maxCount](const Compress& c) { return c.workshop_working >= minCount && c.workshop_working <= maxCount; },
-            "SEARCH CS BY WORKING WORKSHOPS - Range: " + to_string(minCount) + "-" + to_string(maxCount));
+    bool SearchCompressByQuery(const CompressManager& stations, const Query& query, ResultSet<Compress>& results, string& report) {
+        return GenericSearchEngine<Compress>::SearchByQuery(CompressQueryCatalog(stations), query, results, report,
+            LogsSearches() ? "SEARCH CS BY QUERY - Query: '" + query.ToString() + "'" : string());
     }
 };
 
-#endif
+#endif
\ No newline at end of file
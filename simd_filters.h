@@ -0,0 +1,291 @@
+#ifndef SIMD_FILTERS_H
+#define SIMD_FILTERS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_FILTERS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// One bit per storage position, set where the predicate holds.
+struct SelectionBitmap {
+    vector<uint64_t> words;
+    size_t size = 0;
+
+    explicit SelectionBitmap(size_t n = 0) : words((n + 63) / 64, 0), size(n) {}
+
+    bool Test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+    void Set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+
+    // ORs mask in starting at bit i (kernel blocks never exceed 32 bits).
+    void SetBits(size_t i, uint64_t mask) {
+        words[i / 64] |= mask << (i % 64);
+        if (i % 64 != 0 && (mask >> (64 - i % 64)) != 0) {
+            words[i / 64 + 1] |= mask >> (64 - i % 64);
+        }
+    }
+
+    void And(const SelectionBitmap& other) {
+        for (size_t w = 0; w < words.size(); w++) words[w] &= other.words[w];
+    }
+
+    void Or(const SelectionBitmap& other) {
+        for (size_t w = 0; w < words.size(); w++) words[w] |= other.words[w];
+    }
+
+    void Invert() {
+        for (uint64_t& w : words) w = ~w;
+        if (size % 64 != 0) words.back() &= (uint64_t(1) << (size % 64)) - 1;
+    }
+
+    size_t Count() const {
+        size_t count = 0;
+        for (uint64_t w : words) count += __builtin_popcountll(w);
+        return count;
+    }
+
+    vector<uint32_t> ToPositions() const {
+        vector<uint32_t> positions;
+        positions.reserve(Count());
+        for (size_t w = 0; w < words.size(); w++) {
+            uint64_t bits = words[w];
+            while (bits) {
+                positions.push_back((uint32_t)(w * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+        return positions;
+    }
+};
+
+enum class SimdLevel { Scalar, SSE42, AVX2 };
+
+inline SimdLevel DetectSimdLevel() {
+#ifdef SIMD_FILTERS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SimdLevel::SSE42;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// Kernel set used by the Filter* functions; detected once, can be lowered
+// (e.g. to compare against the scalar path).
+inline SimdLevel& ActiveSimdLevel() {
+    static SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+namespace simd_detail {
+
+inline void IntRangeScalar(const int* data, size_t begin, size_t n, int lo, int hi, SelectionBitmap& out) {
+    for (size_t i = begin; i < n; i++) {
+        if (data[i] >= lo && data[i] <= hi) out.Set(i);
+    }
+}
+
+inline void DoubleRangeScalar(const double* data, size_t begin, size_t n, double lo, double hi, SelectionBitmap& out) {
+    for (size_t i = begin; i < n; i++) {
+        if (data[i] >= lo && data[i] <= hi) out.Set(i);
+    }
+}
+
+inline void ByteEqualsScalar(const uint8_t* data, size_t begin, size_t n, uint8_t value, SelectionBitmap& out) {
+    for (size_t i = begin; i < n; i++) {
+        if (data[i] == value) out.Set(i);
+    }
+}
+
+inline void PercentRangeScalar(const int* part, const int* total, size_t begin, size_t n,
+                               double lo, double hi, SelectionBitmap& out) {
+    for (size_t i = begin; i < n; i++) {
+        if (total[i] > 0) {
+            double percentage = (double)part[i] / total[i] * 100;
+            if (percentage >= lo && percentage <= hi) out.Set(i);
+        }
+    }
+}
+
+#ifdef SIMD_FILTERS_X86
+
+__attribute__((target("avx2")))
+inline void IntRangeAVX2(const int* data, size_t n, int lo, int hi, SelectionBitmap& out) {
+    __m256i vlo = _mm256_set1_epi32(lo);
+    __m256i vhi = _mm256_set1_epi32(hi);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, x), _mm256_cmpgt_epi32(x, vhi));
+        uint64_t mask = ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+        if (mask) out.SetBits(i, mask);
+    }
+    IntRangeScalar(data, i, n, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+inline void DoubleRangeAVX2(const double* data, size_t n, double lo, double hi, SelectionBitmap& out) {
+    __m256d vlo = _mm256_set1_pd(lo);
+    __m256d vhi = _mm256_set1_pd(hi);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(data + i);
+        __m256d inside = _mm256_and_pd(_mm256_cmp_pd(x, vlo, _CMP_GE_OQ), _mm256_cmp_pd(x, vhi, _CMP_LE_OQ));
+        uint64_t mask = (uint32_t)_mm256_movemask_pd(inside);
+        if (mask) out.SetBits(i, mask);
+    }
+    DoubleRangeScalar(data, i, n, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+inline void ByteEqualsAVX2(const uint8_t* data, size_t n, uint8_t value, SelectionBitmap& out) {
+    __m256i v = _mm256_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v));
+        if (mask) out.SetBits(i, mask);
+    }
+    ByteEqualsScalar(data, i, n, value, out);
+}
+
+__attribute__((target("avx2")))
+inline void PercentRangeAVX2(const int* part, const int* total, size_t n, double lo, double hi, SelectionBitmap& out) {
+    __m256d vlo = _mm256_set1_pd(lo);
+    __m256d vhi = _mm256_set1_pd(hi);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d hundred = _mm256_set1_pd(100);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d p = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(part + i)));
+        __m256d t = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(total + i)));
+        __m256d percentage = _mm256_mul_pd(_mm256_div_pd(p, t), hundred);
+        __m256d inside = _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GT_OQ),
+            _mm256_and_pd(_mm256_cmp_pd(percentage, vlo, _CMP_GE_OQ), _mm256_cmp_pd(percentage, vhi, _CMP_LE_OQ)));
+        uint64_t mask = (uint32_t)_mm256_movemask_pd(inside);
+        if (mask) out.SetBits(i, mask);
+    }
+    PercentRangeScalar(part, total, i, n, lo, hi, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void IntRangeSSE42(const int* data, size_t n, int lo, int hi, SelectionBitmap& out) {
+    __m128i vlo = _mm_set1_epi32(lo);
+    __m128i vhi = _mm_set1_epi32(hi);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(vlo, x), _mm_cmpgt_epi32(x, vhi));
+        uint64_t mask = ~(uint32_t)_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+        if (mask) out.SetBits(i, mask);
+    }
+    IntRangeScalar(data, i, n, lo, hi, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void DoubleRangeSSE42(const double* data, size_t n, double lo, double hi, SelectionBitmap& out) {
+    __m128d vlo = _mm_set1_pd(lo);
+    __m128d vhi = _mm_set1_pd(hi);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(data + i);
+        __m128d inside = _mm_and_pd(_mm_cmpge_pd(x, vlo), _mm_cmple_pd(x, vhi));
+        uint64_t mask = (uint32_t)_mm_movemask_pd(inside);
+        if (mask) out.SetBits(i, mask);
+    }
+    DoubleRangeScalar(data, i, n, lo, hi, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void ByteEqualsSSE42(const uint8_t* data, size_t n, uint8_t value, SelectionBitmap& out) {
+    __m128i v = _mm_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+        uint64_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+        if (mask) out.SetBits(i, mask);
+    }
+    ByteEqualsScalar(data, i, n, value, out);
+}
+
+__attribute__((target("sse4.2")))
+inline void PercentRangeSSE42(const int* part, const int* total, size_t n, double lo, double hi, SelectionBitmap& out) {
+    __m128d vlo = _mm_set1_pd(lo);
+    __m128d vhi = _mm_set1_pd(hi);
+    __m128d zero = _mm_setzero_pd();
+    __m128d hundred = _mm_set1_pd(100);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d p = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(part + i)));
+        __m128d t = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(total + i)));
+        __m128d percentage = _mm_mul_pd(_mm_div_pd(p, t), hundred);
+        __m128d inside = _mm_and_pd(_mm_cmpgt_pd(t, zero),
+            _mm_and_pd(_mm_cmpge_pd(percentage, vlo), _mm_cmple_pd(percentage, vhi)));
+        uint64_t mask = (uint32_t)_mm_movemask_pd(inside);
+        if (mask) out.SetBits(i, mask);
+    }
+    PercentRangeScalar(part, total, i, n, lo, hi, out);
+}
+
+#endif
+
+}
+
+inline SelectionBitmap FilterIntRange(const vector<int>& column, int lo, int hi) {
+    SelectionBitmap out(column.size());
+    switch (ActiveSimdLevel()) {
+#ifdef SIMD_FILTERS_X86
+    case SimdLevel::AVX2: simd_detail::IntRangeAVX2(column.data(), column.size(), lo, hi, out); break;
+    case SimdLevel::SSE42: simd_detail::IntRangeSSE42(column.data(), column.size(), lo, hi, out); break;
+#endif
+    default: simd_detail::IntRangeScalar(column.data(), 0, column.size(), lo, hi, out);
+    }
+    return out;
+}
+
+inline SelectionBitmap FilterIntEquals(const vector<int>& column, int value) {
+    return FilterIntRange(column, value, value);
+}
+
+inline SelectionBitmap FilterDoubleRange(const vector<double>& column, double lo, double hi) {
+    SelectionBitmap out(column.size());
+    switch (ActiveSimdLevel()) {
+#ifdef SIMD_FILTERS_X86
+    case SimdLevel::AVX2: simd_detail::DoubleRangeAVX2(column.data(), column.size(), lo, hi, out); break;
+    case SimdLevel::SSE42: simd_detail::DoubleRangeSSE42(column.data(), column.size(), lo, hi, out); break;
+#endif
+    default: simd_detail::DoubleRangeScalar(column.data(), 0, column.size(), lo, hi, out);
+    }
+    return out;
+}
+
+inline SelectionBitmap FilterByteEquals(const vector<uint8_t>& column, uint8_t value) {
+    SelectionBitmap out(column.size());
+    switch (ActiveSimdLevel()) {
+#ifdef SIMD_FILTERS_X86
+    case SimdLevel::AVX2: simd_detail::ByteEqualsAVX2(column.data(), column.size(), value, out); break;
+    case SimdLevel::SSE42: simd_detail::ByteEqualsSSE42(column.data(), column.size(), value, out); break;
+#endif
+    default: simd_detail::ByteEqualsScalar(column.data(), 0, column.size(), value, out);
+    }
+    return out;
+}
+
+// part / total * 100 within [lo, hi]; rows with total <= 0 never match.
+inline SelectionBitmap FilterPercentRange(const vector<int>& part, const vector<int>& total, double lo, double hi) {
+    SelectionBitmap out(total.size());
+    switch (ActiveSimdLevel()) {
+#ifdef SIMD_FILTERS_X86
+    case SimdLevel::AVX2: simd_detail::PercentRangeAVX2(part.data(), total.data(), total.size(), lo, hi, out); break;
+    case SimdLevel::SSE42: simd_detail::PercentRangeSSE42(part.data(), total.data(), total.size(), lo, hi, out); break;
+#endif
+    default: simd_detail::PercentRangeScalar(part.data(), total.data(), 0, total.size(), lo, hi, out);
+    }
+    return out;
+}
+
+#endif
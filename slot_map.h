@@ -0,0 +1,114 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+using namespace std;
+
+// Stable reference to a record. Stays valid across deletes of other
+// records; a deleted record's handle is rejected by the generation check.
+struct Handle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Handle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Live values are kept contiguous; slots give them stable handles.
+// Erase moves the last value into the hole, so it is O(1) but does not
+// keep insertion order.
+template<typename T>
+class SlotMap {
+private:
+    struct Slot {
+        uint32_t position;
+        uint32_t generation;
+    };
+
+    vector<T> values;
+    vector<uint32_t> owners;      // position -> slot
+    vector<Slot> slots;
+    vector<uint32_t> freeSlots;
+
+public:
+    template<typename V>
+    Handle Insert(V&& value) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (uint32_t)slots.size();
+            slots.push_back({0, 0});
+        }
+        slots[slot].position = (uint32_t)values.size();
+        values.push_back(forward<V>(value));
+        owners.push_back(slot);
+        return {slot, slots[slot].generation};
+    }
+
+    bool Contains(Handle h) const {
+        return h.slot < slots.size() && slots[h.slot].generation == h.generation;
+    }
+
+    T* Get(Handle h) { return Contains(h) ? &values[slots[h.slot].position] : nullptr; }
+    const T* Get(Handle h) const { return Contains(h) ? &values[slots[h.slot].position] : nullptr; }
+
+    Handle HandleOfSlot(uint32_t slot) const {
+        return slot < slots.size() ? Handle{slot, slots[slot].generation} : Handle{};
+    }
+
+    Handle HandleAt(size_t position) const {
+        uint32_t slot = owners[position];
+        return {slot, slots[slot].generation};
+    }
+
+    size_t PositionOf(Handle h) const { return slots[h.slot].position; }
+
+    bool Erase(Handle h) {
+        if (!Contains(h)) return false;
+        uint32_t position = slots[h.slot].position;
+        uint32_t last = (uint32_t)values.size() - 1;
+        if (position != last) {
+            values[position] = move(values[last]);
+            owners[position] = owners[last];
+            slots[owners[position]].position = position;
+        }
+        values.pop_back();
+        owners.pop_back();
+        slots[h.slot].generation++;
+        freeSlots.push_back(h.slot);
+        return true;
+    }
+
+    void Clear() {
+        for (uint32_t slot : owners) {
+            slots[slot].generation++;
+            freeSlots.push_back(slot);
+        }
+        values.clear();
+        owners.clear();
+    }
+
+    // Grows by at least half, so ranges added one after another (CSV
+    // import batches) don't copy every record each time.
+    void Reserve(size_t n) {
+        if (n <= values.capacity()) return;
+        n = max(n, values.capacity() + values.capacity() / 2);
+        values.reserve(n);
+        owners.reserve(n);
+        slots.reserve(n);
+    }
+
+    size_t Size() const { return values.size(); }
+    bool Empty() const { return values.empty(); }
+
+    const vector<T>& Values() const { return values; }
+    vector<T>& Values() { return values; }
+};
+
+#endif
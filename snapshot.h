@@ -0,0 +1,271 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "structs.h"
+#include "mapped_file.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <chrono>
+
+using namespace std;
+
+// Binary snapshot of all pipes and stations:
+//
+//   SnapshotHeader                      fixed 96 bytes
+//   SnapshotPipe     x pipeCount        fixed 32 bytes each
+//   SnapshotStation  x stationCount     fixed 32 bytes each
+//   string heap                         km marks, names, classifications
+//
+// Strings are (offset, length) pairs into the heap. Everything is
+// little-endian, as written by the host; the sections are 8-byte aligned
+// so a mapped file can be read in place. The header carries a checksum
+// of itself, of the record arrays and of the heap.
+
+static const char SNAPSHOT_MAGIC[8] = {'P', 'I', 'P', 'E', 'S', 'N', 'P', '\n'};
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t createdAt;         // nanoseconds since the Unix epoch
+    uint64_t pipeCount;
+    uint64_t stationCount;
+    uint64_t pipeOffset;
+    uint64_t stationOffset;
+    uint64_t heapOffset;
+    uint64_t heapSize;
+    uint64_t recordsChecksum;   // pipe array, mixed with the station array
+    uint64_t heapChecksum;
+    uint64_t headerChecksum;    // every field above
+};
+
+struct SnapshotString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotPipe {
+    int32_t id;
+    int32_t diameter;
+    double length;
+    SnapshotString kmMark;
+    uint8_t repair;
+    uint8_t reserved[7];
+};
+
+struct SnapshotStation {
+    int32_t id;
+    int32_t workshopCount;
+    int32_t workshopWorking;
+    uint8_t working;
+    uint8_t reserved[3];
+    SnapshotString name;
+    SnapshotString classification;
+};
+
+static_assert(sizeof(SnapshotHeader) == 96, "snapshot header layout");
+static_assert(sizeof(SnapshotPipe) == 32, "snapshot pipe layout");
+static_assert(sizeof(SnapshotStation) == 32, "snapshot station layout");
+
+// Four independent multiply-rotate lanes over 8-byte words, so the
+// checksum runs at memory speed instead of one byte per step.
+inline uint64_t SnapshotChecksum(const char* p, size_t n) {
+    const uint64_t prime = 0x9E3779B185EBCA87ull;
+    uint64_t lanes[4] = {n, prime, ~n, prime ^ n};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t w;
+            memcpy(&w, p + i + l * 8, 8);
+            lanes[l] = ((lanes[l] ^ w) * prime);
+            lanes[l] = (lanes[l] << 31) | (lanes[l] >> 33);
+        }
+    }
+    uint64_t h = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+    for (; i < n; i++) {
+        h = (h ^ uint8_t(p[i])) * prime;
+    }
+    h ^= h >> 29;
+    h *= prime;
+    return h ^ (h >> 32);
+}
+
+inline bool IsSnapshotFile(const string& filename) {
+    ifstream in(filename, ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+// Writes a snapshot in one pass: the records and heap are assembled in
+// memory and written with three large writes. Returns false if the file
+// can't be written.
+inline bool WriteSnapshot(const string& filename, const vector<Pipe>& pipes, const vector<Compress>& stations) {
+    string heap;
+    auto intern = [&heap](const string& s) {
+        SnapshotString ref{static_cast<uint32_t>(heap.size()), static_cast<uint32_t>(s.size())};
+        heap += s;
+        return ref;
+    };
+
+    vector<SnapshotPipe> pipeRecords(pipes.size());
+    for (size_t i = 0; i < pipes.size(); i++) {
+        const Pipe& pipe = pipes[i];
+        SnapshotPipe& r = pipeRecords[i];
+        memset(&r, 0, sizeof(r));
+        r.id = pipe.id;
+        r.diameter = pipe.diametr;
+        r.length = pipe.length;
+        r.kmMark = intern(pipe.km_mark);
+        r.repair = pipe.repair ? 1 : 0;
+    }
+
+    vector<SnapshotStation> stationRecords(stations.size());
+    for (size_t i = 0; i < stations.size(); i++) {
+        const Compress& station = stations[i];
+        SnapshotStation& r = stationRecords[i];
+        memset(&r, 0, sizeof(r));
+        r.id = station.id;
+        r.workshopCount = station.workshop_count;
+        r.workshopWorking = station.workshop_working;
+        r.working = station.working ? 1 : 0;
+        r.name = intern(station.name);
+        r.classification = intern(station.classification);
+    }
+    if (heap.size() > UINT32_MAX) return false;
+
+    size_t pipeBytes = pipeRecords.size() * sizeof(SnapshotPipe);
+    size_t stationBytes = stationRecords.size() * sizeof(SnapshotStation);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.createdAt = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count());
+    header.pipeCount = pipeRecords.size();
+    header.stationCount = stationRecords.size();
+    header.pipeOffset = sizeof(SnapshotHeader);
+    header.stationOffset = header.pipeOffset + pipeBytes;
+    header.heapOffset = header.stationOffset + stationBytes;
+    header.heapSize = heap.size();
+
+    uint64_t pipeSum = SnapshotChecksum(reinterpret_cast<const char*>(pipeRecords.data()), pipeBytes);
+    uint64_t stationSum = SnapshotChecksum(reinterpret_cast<const char*>(stationRecords.data()), stationBytes);
+    header.recordsChecksum = pipeSum ^ (stationSum * 0x9E3779B185EBCA87ull);
+    header.heapChecksum = SnapshotChecksum(heap.data(), heap.size());
+    header.headerChecksum = SnapshotChecksum(reinterpret_cast<const char*>(&header), offsetof(SnapshotHeader, headerChecksum));
+
+    ofstream out(filename, ios::binary | ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(pipeRecords.data()), streamsize(pipeBytes));
+    out.write(reinterpret_cast<const char*>(stationRecords.data()), streamsize(stationBytes));
+    out.write(heap.data(), streamsize(heap.size()));
+    out.close();
+    return !out.fail();
+}
+
+// Read-only view of a mapped snapshot. Open() checks the header, the
+// section bounds and all checksums; after that records are decoded in
+// place with no parsing.
+class SnapshotReader {
+private:
+    MappedFile file;
+    SnapshotHeader header{};
+    const SnapshotPipe* pipes = nullptr;
+    const SnapshotStation* stations = nullptr;
+    const char* heap = nullptr;
+    string error;
+
+    bool Fail(const string& reason) {
+        error = reason;
+        file.Close();
+        return false;
+    }
+
+    bool StringInHeap(const SnapshotString& s) const {
+        return uint64_t(s.offset) + s.length <= header.heapSize;
+    }
+
+    string Text(const SnapshotString& s) const { return string(heap + s.offset, s.length); }
+
+public:
+    bool Open(const string& filename) {
+        error.clear();
+        if (!file.Open(filename)) return Fail("cannot open file");
+        if (file.Size() < sizeof(SnapshotHeader)) return Fail("file too short");
+        memcpy(&header, file.Data(), sizeof(header));
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) return Fail("not a snapshot");
+        if (header.version != SNAPSHOT_VERSION) return Fail("unsupported version " + to_string(header.version));
+        if (header.headerChecksum != SnapshotChecksum(file.Data(), offsetof(SnapshotHeader, headerChecksum)))
+            return Fail("header checksum mismatch");
+
+        uint64_t pipeBytes = header.pipeCount * sizeof(SnapshotPipe);
+        uint64_t stationBytes = header.stationCount * sizeof(SnapshotStation);
+        if (header.pipeCount > file.Size() / sizeof(SnapshotPipe) ||
+            header.stationCount > file.Size() / sizeof(SnapshotStation) ||
+            header.pipeOffset != header.headerSize ||
+            header.stationOffset != header.pipeOffset + pipeBytes ||
+            header.heapOffset != header.stationOffset + stationBytes ||
+            header.heapOffset + header.heapSize != file.Size())
+            return Fail("section sizes do not match the file");
+
+        const char* base = file.Data();
+        uint64_t pipeSum = SnapshotChecksum(base + header.pipeOffset, pipeBytes);
+        uint64_t stationSum = SnapshotChecksum(base + header.stationOffset, stationBytes);
+        if (header.recordsChecksum != (pipeSum ^ (stationSum * 0x9E3779B185EBCA87ull)))
+            return Fail("record checksum mismatch");
+        if (header.heapChecksum != SnapshotChecksum(base + header.heapOffset, header.heapSize))
+            return Fail("string heap checksum mismatch");
+
+        pipes = reinterpret_cast<const SnapshotPipe*>(base + header.pipeOffset);
+        stations = reinterpret_cast<const SnapshotStation*>(base + header.stationOffset);
+        heap = base + header.heapOffset;
+        for (size_t i = 0; i < header.pipeCount; i++) {
+            if (!StringInHeap(pipes[i].kmMark)) return Fail("pipe " + to_string(i) + ": string out of range");
+        }
+        for (size_t i = 0; i < header.stationCount; i++) {
+            if (!StringInHeap(stations[i].name) || !StringInHeap(stations[i].classification))
+                return Fail("station " + to_string(i) + ": string out of range");
+        }
+        return true;
+    }
+
+    // Why the last Open() failed.
+    const string& Error() const { return error; }
+
+    size_t PipeCount() const { return header.pipeCount; }
+    size_t StationCount() const { return header.stationCount; }
+    int64_t CreatedAt() const { return static_cast<int64_t>(header.createdAt); }
+
+    Pipe PipeAt(size_t i) const {
+        const SnapshotPipe& r = pipes[i];
+        Pipe pipe;
+        pipe.id = r.id;
+        pipe.km_mark = Text(r.kmMark);
+        pipe.length = r.length;
+        pipe.diametr = r.diameter;
+        pipe.repair = r.repair != 0;
+        return pipe;
+    }
+
+    Compress StationAt(size_t i) const {
+        const SnapshotStation& r = stations[i];
+        Compress station;
+        station.id = r.id;
+        station.name = Text(r.name);
+        station.workshop_count = r.workshopCount;
+        station.workshop_working = r.workshopWorking;
+        station.classification = Text(r.classification);
+        station.working = r.working != 0;
+        return station;
+    }
+};
+
+#endif
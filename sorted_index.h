@@ -0,0 +1,176 @@
+#ifndef SORTED_INDEX_H
+#define SORTED_INDEX_H
+
+#include "generic_manager.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+// Ordered (key, id) pairs over one field of T, maintained on every
+// manager change. Entries live in a list of small sorted blocks (a
+// flattened B-tree), so an insert or delete only shifts one block and a
+// range lookup is a binary search plus the hits.
+template<typename T, typename Key>
+class SortedIndex : public ManagerListener<T> {
+public:
+    // Returns false for records that should not be indexed.
+    using KeyFn = bool (*)(const T& item, Key& key);
+
+private:
+    using Entry = pair<Key, int>;
+
+    static constexpr size_t BLOCK_SIZE = 512;
+
+    KeyFn keyOf;
+    vector<vector<Entry>> blocks;
+    size_t count = 0;
+
+    // First block whose last entry is not less than entry.
+    size_t BlockFor(const Entry& entry) const {
+        return lower_bound(blocks.begin(), blocks.end(), entry,
+            [](const vector<Entry>& block, const Entry& e) { return block.back() < e; }) - blocks.begin();
+    }
+
+    void Insert(const T& item) {
+        Entry entry;
+        if (!keyOf(item, entry.first)) return;
+        entry.second = item.id;
+
+        count++;
+        if (blocks.empty()) {
+            blocks.push_back({entry});
+            return;
+        }
+        size_t b = min(BlockFor(entry), blocks.size() - 1);
+        vector<Entry>& block = blocks[b];
+        block.insert(upper_bound(block.begin(), block.end(), entry), entry);
+
+        if (block.size() >= 2 * BLOCK_SIZE) {
+            vector<Entry> upper(block.begin() + BLOCK_SIZE, block.end());
+            block.resize(BLOCK_SIZE);
+            blocks.insert(blocks.begin() + b + 1, move(upper));
+        }
+    }
+
+    // Merges a batch into the entries and cuts them into fresh blocks,
+    // which beats one Insert per record once the batch isn't tiny.
+    void Rebuild(const T* values, size_t n) {
+        vector<Entry> added;
+        added.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            Entry entry;
+            if (keyOf(values[i], entry.first)) {
+                entry.second = values[i].id;
+                added.push_back(entry);
+            }
+        }
+        sort(added.begin(), added.end());
+
+        vector<Entry> all;
+        all.reserve(count + added.size());
+        for (const auto& block : blocks) all.insert(all.end(), block.begin(), block.end());
+        size_t middle = all.size();
+        all.insert(all.end(), added.begin(), added.end());
+        inplace_merge(all.begin(), all.begin() + middle, all.end());
+
+        blocks.clear();
+        for (size_t i = 0; i < all.size(); i += BLOCK_SIZE) {
+            blocks.emplace_back(all.begin() + i, all.begin() + min(all.size(), i + BLOCK_SIZE));
+        }
+        count = all.size();
+    }
+
+    void Remove(const T& item) {
+        Entry entry;
+        if (!keyOf(item, entry.first)) return;
+        entry.second = item.id;
+
+        size_t b = BlockFor(entry);
+        if (b == blocks.size()) return;
+        vector<Entry>& block = blocks[b];
+        auto it = lower_bound(block.begin(), block.end(), entry);
+        if (it == block.end() || *it != entry) return;
+        block.erase(it);
+        count--;
+        if (block.empty()) blocks.erase(blocks.begin() + b);
+    }
+
+    // Position (block, offset) of the first entry with key >= lo, and of
+    // the first entry with key > hi.
+    pair<pair<size_t, size_t>, pair<size_t, size_t>> Bounds(const Key& lo, const Key& hi) const {
+        auto below = [](const Entry& e, const Key& k) { return e.first < k; };
+        auto above = [](const Key& k, const Entry& e) { return k < e.first; };
+
+        size_t b1 = lower_bound(blocks.begin(), blocks.end(), lo,
+            [](const vector<Entry>& block, const Key& k) { return block.back().first < k; }) - blocks.begin();
+        size_t o1 = b1 < blocks.size() ? lower_bound(blocks[b1].begin(), blocks[b1].end(), lo, below) - blocks[b1].begin() : 0;
+
+        if (hi < lo) return {{b1, o1}, {b1, o1}};
+
+        size_t b2 = upper_bound(blocks.begin(), blocks.end(), hi,
+            [](const Key& k, const vector<Entry>& block) { return k < block.back().first; }) - blocks.begin();
+        size_t o2 = b2 < blocks.size() ? upper_bound(blocks[b2].begin(), blocks[b2].end(), hi, above) - blocks[b2].begin() : 0;
+        return {{b1, o1}, {b2, o2}};
+    }
+
+public:
+    explicit SortedIndex(KeyFn fn) : keyOf(fn) {}
+
+    void OnInserted(const T& item, size_t) override { Insert(item); }
+
+    void OnInsertedRange(const T* values, size_t n, size_t) override {
+        if (n * 16 < count) {
+            for (size_t i = 0; i < n; i++) Insert(values[i]);
+        } else {
+            Rebuild(values, n);
+        }
+    }
+    void OnErased(const T& item, size_t, size_t) override { Remove(item); }
+
+    void OnUpdated(const T& before, const T& after, size_t) override {
+        Key oldKey, newKey;
+        bool hadKey = keyOf(before, oldKey);
+        bool hasKey = keyOf(after, newKey);
+        if (hadKey == hasKey && (!hasKey || oldKey == newKey)) return;
+        Remove(before);
+        Insert(after);
+    }
+
+    void OnCleared() override {
+        blocks.clear();
+        count = 0;
+    }
+
+    // Ids with lo <= key <= hi, in key order.
+    vector<int> Range(const Key& lo, const Key& hi) const {
+        auto bounds = Bounds(lo, hi);
+        vector<int> ids;
+        size_t b = bounds.first.first, o = bounds.first.second;
+        while (b < bounds.second.first || (b == bounds.second.first && o < bounds.second.second)) {
+            if (o == blocks[b].size()) {
+                b++;
+                o = 0;
+                continue;
+            }
+            ids.push_back(blocks[b][o++].second);
+        }
+        return ids;
+    }
+
+    size_t CountRange(const Key& lo, const Key& hi) const {
+        auto bounds = Bounds(lo, hi);
+        size_t b1 = bounds.first.first, o1 = bounds.first.second;
+        size_t b2 = bounds.second.first, o2 = bounds.second.second;
+        if (b1 > b2 || (b1 == b2 && o1 >= o2)) return 0;
+        if (b1 == b2) return o2 - o1;
+        size_t total = blocks[b1].size() - o1 + o2;
+        for (size_t b = b1 + 1; b < b2; b++) total += blocks[b].size();
+        return total;
+    }
+
+    size_t Size() const { return count; }
+};
+
+#endif
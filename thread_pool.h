@@ -0,0 +1,121 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+
+// Whether a bulk operation may spread its work over a ThreadPool.
+enum class ExecutionMode { Serial, Parallel };
+
+// Fixed set of worker threads fed from one task queue. ParallelFor is the
+// main entry point: the calling thread works on the batch too and returns
+// once every task index has run.
+class ThreadPool {
+private:
+    struct Batch {
+        const function<void(size_t)>* task;
+        size_t count;
+        atomic<size_t> next{0};
+        atomic<size_t> finished{0};
+        mutex doneMutex;
+        condition_variable done;
+    };
+
+    vector<thread> workers;
+    deque<function<void()>> queue;
+    mutex queueMutex;
+    condition_variable wake;
+    bool stopping = false;
+
+    void WorkerLoop() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping && queue.empty()) return;
+                job = move(queue.front());
+                queue.pop_front();
+            }
+            job();
+        }
+    }
+
+    // Claims task indexes until none are left. Helpers that start after
+    // the batch has finished find nothing to do, so the task reference is
+    // never touched once ParallelFor has returned.
+    static void Drain(Batch& batch) {
+        size_t i;
+        while ((i = batch.next.fetch_add(1)) < batch.count) {
+            (*batch.task)(i);
+            if (batch.finished.fetch_add(1) + 1 == batch.count) {
+                lock_guard<mutex> lock(batch.doneMutex);
+                batch.done.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    // Worker threads plus the caller.
+    size_t Concurrency() const { return workers.size() + 1; }
+
+    void Submit(function<void()> job) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queue.push_back(move(job));
+        }
+        wake.notify_one();
+    }
+
+    // Runs task(0) .. task(count - 1) across the pool and waits for all.
+    void ParallelFor(size_t count, const function<void(size_t)>& task) {
+        if (count == 0) return;
+        auto batch = make_shared<Batch>();
+        batch->task = &task;
+        batch->count = count;
+
+        size_t helpers = min(workers.size(), count - 1);
+        for (size_t i = 0; i < helpers; i++) {
+            Submit([batch] { Drain(*batch); });
+        }
+        Drain(*batch);
+
+        unique_lock<mutex> lock(batch->doneMutex);
+        batch->done.wait(lock, [&batch] { return batch->finished.load() == batch->count; });
+    }
+
+    // Process-wide pool sized to the machine, created on first use.
+    static ThreadPool& Shared() {
+        static ThreadPool pool(max(1u, thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include "generic_manager.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+// Inverted index from every 3-byte substring of a text field to the
+// sorted ids containing it. A substring query intersects the posting
+// lists of its trigrams and verifies the survivors with find().
+template<typename T>
+class TrigramIndex : public ManagerListener<T> {
+public:
+    using TextFn = const string& (*)(const T& item);
+
+private:
+    TextFn textOf;
+    unordered_map<uint32_t, vector<int>> postings;
+
+    static vector<uint32_t> Trigrams(const string& text) {
+        vector<uint32_t> grams;
+        for (size_t i = 0; i + 3 <= text.size(); i++) {
+            grams.push_back((uint32_t)(unsigned char)text[i] << 16 |
+                            (uint32_t)(unsigned char)text[i + 1] << 8 |
+                            (uint32_t)(unsigned char)text[i + 2]);
+        }
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    void Insert(const string& text, int id) {
+        for (uint32_t gram : Trigrams(text)) {
+            vector<int>& list = postings[gram];
+            if (list.empty() || list.back() < id) {
+                list.push_back(id);
+            } else {
+                auto it = lower_bound(list.begin(), list.end(), id);
+                if (it == list.end() || *it != id) list.insert(it, id);
+            }
+        }
+    }
+
+    void Remove(const string& text, int id) {
+        for (uint32_t gram : Trigrams(text)) {
+            auto entry = postings.find(gram);
+            if (entry == postings.end()) continue;
+            vector<int>& list = entry->second;
+            auto it = lower_bound(list.begin(), list.end(), id);
+            if (it != list.end() && *it == id) list.erase(it);
+            if (list.empty()) postings.erase(entry);
+        }
+    }
+
+public:
+    explicit TrigramIndex(TextFn fn) : textOf(fn) {}
+
+    void OnInserted(const T& item, size_t) override { Insert(textOf(item), item.id); }
+
+    // Loaded ids needn't arrive in order, and inserting each one into the
+    // middle of a long posting list is quadratic. Sort (trigram, id)
+    // pairs instead and merge each run into its list once.
+    void OnInsertedRange(const T* values, size_t count, size_t) override {
+        vector<pair<uint32_t, int>> pairs;
+        for (size_t i = 0; i < count; i++) {
+            for (uint32_t gram : Trigrams(textOf(values[i]))) pairs.push_back({gram, values[i].id});
+        }
+        sort(pairs.begin(), pairs.end());
+
+        for (size_t i = 0; i < pairs.size();) {
+            uint32_t gram = pairs[i].first;
+            vector<int>& list = postings[gram];
+            size_t middle = list.size();
+            for (; i < pairs.size() && pairs[i].first == gram; i++) list.push_back(pairs[i].second);
+            if (middle > 0 && list[middle - 1] >= list[middle]) {
+                inplace_merge(list.begin(), list.begin() + middle, list.end());
+            }
+            list.erase(unique(list.begin(), list.end()), list.end());
+        }
+    }
+
+    void OnErased(const T& item, size_t, size_t) override { Remove(textOf(item), item.id); }
+
+    void OnUpdated(const T& before, const T& after, size_t) override {
+        if (textOf(before) == textOf(after)) return;
+        Remove(textOf(before), before.id);
+        Insert(textOf(after), after.id);
+    }
+
+    void OnCleared() override { postings.clear(); }
+
+    // Upper bound on the number of matches, or SIZE_MAX if the query is
+    // too short to use the index.
+    size_t EstimateMatches(const string& query) const {
+        if (query.size() < 3) return SIZE_MAX;
+        size_t best = SIZE_MAX;
+        for (uint32_t gram : Trigrams(query)) {
+            auto it = postings.find(gram);
+            best = min(best, it == postings.end() ? (size_t)0 : it->second.size());
+        }
+        return best;
+    }
+
+    // Ids whose text contains query, in id order. Returns false for
+    // queries shorter than a trigram; the caller has to scan then.
+    bool Find(const GenericManager<T>& manager, const string& query, vector<int>& ids) const {
+        ids.clear();
+        if (query.size() < 3) return false;
+
+        vector<const vector<int>*> lists;
+        for (uint32_t gram : Trigrams(query)) {
+            auto it = postings.find(gram);
+            if (it == postings.end()) return true;
+            lists.push_back(&it->second);
+        }
+        sort(lists.begin(), lists.end(),
+            [](const vector<int>* a, const vector<int>* b) { return a->size() < b->size(); });
+
+        ids = *lists[0];
+        for (size_t i = 1; i < lists.size() && !ids.empty(); i++) {
+            vector<int> next;
+            set_intersection(ids.begin(), ids.end(), lists[i]->begin(), lists[i]->end(), back_inserter(next));
+            ids.swap(next);
+        }
+
+        ids.erase(remove_if(ids.begin(), ids.end(), [&](int id) {
+            const T* item = manager.FindById(id);
+            return !item || textOf(*item).find(query) == string::npos;
+        }), ids.end());
+        return true;
+    }
+};
+
+#endif
@@ -5,9 +5,11 @@
 #include "compress_manager.h"
 #include "file_manager.h"
 #include "search_engine.h"
+#include "log_viewer.h"
 #include <iostream>
 #include <limits>
 #include <iomanip>
+#include <fstream>
 
 using namespace std;
 
@@ -19,6 +21,9 @@ private:
     FileManager& fileManager;
     SearchEngine searchEngine;
 
+    static constexpr size_t RESULTS_PAGE_SIZE = 20;
+    static constexpr size_t LOG_PAGE_SIZE = 50;
+
 public:
     UIController(PipeManager& pm, CompressManager& cm, Logger& log, FileManager& fm)
         : pipeManager(pm), compressManager(cm), logger(log), fileManager(fm), searchEngine(log) {}
@@ -36,7 +41,7 @@ public:
             cout << "Error: Invalid length.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add pipe - invalid length");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to add pipe - invalid length");
             return;
         }
 
@@ -46,7 +51,7 @@ public:
             cout << "Error: Invalid diameter.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add pipe - invalid diameter");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to add pipe - invalid diameter");
             return;
         }
 
@@ -56,7 +61,7 @@ public:
             cout << "Error: Invalid input.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add pipe - invalid repair status");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to add pipe - invalid repair status");
             return;
         }
 
@@ -77,7 +82,7 @@ public:
             cout << "Error: Invalid quantity.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add CS - invalid workshop quantity");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to add CS - invalid workshop quantity");
             return;
         }
 
@@ -87,7 +92,7 @@ public:
             cout << "Error: Invalid working quantity.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add CS - invalid working quantity");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to add CS - invalid working quantity");
             return;
         }
 
@@ -101,7 +106,7 @@ public:
             cout << "Error: Invalid input.\n";
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to add CS - invalid working status");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to add CS - invalid working status");
             return;
         }
 
@@ -110,36 +115,34 @@ public:
     }
 
     void ViewAllPipes() {
-        const auto& pipes = pipeManager.GetAll();
-        if (pipes.empty()) {
+        if (pipeManager.Empty()) {
             cout << "\nNo pipes available.\n";
             return;
         }
         cout << "\n===== All Pipes =====\n";
-        for (const auto& pipe : pipes) {
+        pipeManager.ForEach([](const Pipe& pipe) {
             cout << "ID: " << pipe.id << " | KM: " << pipe.km_mark
                  << " | Length: " << fixed << setprecision(2) << pipe.length << " km"
                  << " | Diameter: " << pipe.diametr << " mm"
                  << " | On repair: " << (pipe.repair ? "Yes" : "No") << "\n";
-        }
-        logger.Log("VIEWED ALL PIPES - Total: " + to_string(pipes.size()));
+        });
+        LOG_EVENT(logger, LogEvent::ViewedAllPipes, pipeManager.Size());
     }
 
     void ViewAllCompress() {
-        const auto& stations = compressManager.GetAll();
-        if (stations.empty()) {
+        if (compressManager.Empty()) {
             cout << "\nNo CS available.\n";
             return;
         }
         cout << "\n===== All CS =====\n";
-        for (const auto& station : stations) {
+        compressManager.ForEach([](const Compress& station) {
             cout << "ID: " << station.id << " | Name: " << station.name
                  << " | Workshops: " << station.workshop_count
                  << " | Working: " << station.workshop_working
                  << " | Class: " << station.classification
                  << " | Active: " << (station.working ? "Yes" : "No") << "\n";
-        }
-        logger.Log("VIEWED ALL CS - Total: " + to_string(stations.size()));
+        });
+        LOG_EVENT(logger, LogEvent::ViewedAllCs, compressManager.Size());
     }
 
     void EditPipe() {
@@ -150,14 +153,14 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to edit pipe - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to edit pipe - invalid ID");
             return;
         }
 
-        Pipe* pipe = pipeManager.FindById(id);
+        const Pipe* pipe = pipeManager.FindById(id);
         if (!pipe) {
             cout << "Error: Pipe not found.\n";
-            logger.Log("ERROR: Pipe not found - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Pipe not found - ID: " + to_string(id));
             return;
         }
 
@@ -174,14 +177,14 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to edit CS - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to edit CS - invalid ID");
             return;
         }
 
-        Compress* station = compressManager.FindById(id);
+        const Compress* station = compressManager.FindById(id);
         if (!station) {
             cout << "Error: CS not found.\n";
-            logger.Log("ERROR: CS not found - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: CS not found - ID: " + to_string(id));
             return;
         }
 
@@ -198,7 +201,7 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to delete pipe - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to delete pipe - invalid ID");
             return;
         }
 
@@ -206,7 +209,7 @@ public:
             cout << "Pipe deleted successfully!\n";
         } else {
             cout << "Error: Pipe not found.\n";
-            logger.Log("ERROR: Pipe not found for deletion - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Pipe not found for deletion - ID: " + to_string(id));
         }
     }
 
@@ -218,7 +221,7 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to delete CS - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to delete CS - invalid ID");
             return;
         }
 
@@ -226,27 +229,61 @@ public:
             cout << "CS deleted successfully!\n";
         } else {
             cout << "Error: CS not found.\n";
-            logger.Log("ERROR: CS not found for deletion - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: CS not found for deletion - ID: " + to_string(id));
         }
     }
 
     void SaveData() {
+        SaveStatus status = fileManager.GetSaveStatus();
+        if (status.running) {
+            cout << "\nA save to " << status.filename << " is still running (" << SavePercent(status)
+                 << "%). Try again when it has finished.\n";
+            return;
+        }
+
         string filename;
-        cout << "\nEnter filename to save (or press Enter for default 'data_backup.txt'): ";
+        cout << "\nEnter filename to save (or press Enter for default 'data_backup.txt', end it in .bin for a binary snapshot or .pack for a compressed one): ";
         cin.ignore();
         getline(cin, filename);
 
-        if (filename.empty()) {
-            fileManager.SaveAllData(pipeManager, compressManager);
-        } else {
-            if (filename.find('.') == string::npos) {
-                filename += ".txt";
+        if (!filename.empty() && filename.find('.') == string::npos) {
+            filename += ".txt";
+        }
+        if (!fileManager.SaveAllDataAsync(pipeManager, compressManager, filename)) return;
+        cout << "Saving " << pipeManager.Size() << " pipes and " << compressManager.Size()
+             << " CS to " << fileManager.GetSaveStatus().filename << " in the background.\n";
+    }
+
+    // Called before each menu: reports a finished background save, or
+    // the progress of a running one.
+    void ReportBackgroundSave() {
+        SaveResult result;
+        if (fileManager.TakeSaveResult(result)) {
+            if (result.ok) {
+                cout << "\nBackground save to " << result.filename << " finished: " << result.pipes << " pipes, "
+                     << result.stations << " CS in " << fixed << setprecision(0) << result.milliseconds << " ms.\n";
+            } else {
+                cout << "\nError: Background save to " << result.filename << " failed; the previous file is unchanged.\n";
             }
-            fileManager.SaveAllData(pipeManager, compressManager, filename);
+            return;
+        }
+        SaveStatus status = fileManager.GetSaveStatus();
+        if (status.running) {
+            cout << "\n[Saving " << status.filename << ": " << SavePercent(status) << "%]\n";
+        }
+    }
+
+    void FinishBackgroundSave() {
+        if (fileManager.GetSaveStatus().running) {
+            cout << "\nWaiting for the background save to finish...\n";
         }
+        fileManager.WaitForSave();
+        ReportBackgroundSave();
     }
 
     void LoadData(int& nextPipeId, int& nextCompressId) {
+        FinishBackgroundSave();
+
         string filename;
         cout << "\nEnter filename to load (or press Enter for default 'data_backup.txt'): ";
         cin.ignore();
@@ -263,12 +300,147 @@ public:
     }
 
     void ViewLogs() {
-        logger.ViewLogs();
+        logger.Flush();
+        LogViewer viewer(logger.BaseName());
+        if (!viewer.Open()) {
+            cout << "\nNo log file found yet.\n";
+            return;
+        }
+
+        cout << "\n===== View Logs =====\n";
+        cout << "1. All entries\n";
+        cout << "2. Last N entries\n";
+        cout << "3. Time range\n";
+        cout << "Choose an option: ";
+        int mode;
+        cin >> mode;
+        if (cin.fail() || mode < 1 || mode > 3) {
+            cout << "Error: Invalid option.\n";
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            return;
+        }
+
+        LogFilter filter;
+        size_t tail = 0;
+        if (mode == 2) {
+            cout << "Enter number of entries: ";
+            cin >> tail;
+            if (cin.fail() || tail == 0) {
+                cout << "Error: Invalid number.\n";
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                return;
+            }
+        }
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        if (mode == 3) {
+            string from, to;
+            cout << "From (YYYY-MM-DD [HH:MM[:SS]]): ";
+            getline(cin, from);
+            cout << "To (YYYY-MM-DD [HH:MM[:SS]], Enter for now): ";
+            getline(cin, to);
+            if (!ParseLogTime(from, false, filter.from) || (!to.empty() && !ParseLogTime(to, true, filter.to))) {
+                cout << "Error: Invalid date.\n";
+                return;
+            }
+        }
+
+        cout << "Filter by type (e.g. ADDED PIPE, SEARCH, LOADED ALL DATA, ERROR; Enter for all): ";
+        getline(cin, filter.type);
+        for (char& c : filter.type) c = char(toupper(static_cast<unsigned char>(c)));
+
+        LogPosition start = viewer.Begin();
+        if (mode == 2) start = viewer.TailStart(tail, filter);
+        else if (mode == 3) start = viewer.SeekTime(filter.from);
+        PageLogs(viewer, start, filter);
+    }
+
+    void ExportLogs() {
+        string filename;
+        cout << "\nEnter filename to export logs (or press Enter for default 'operations_log_export.txt'): ";
+        cin.ignore();
+        getline(cin, filename);
+
+        if (filename.empty()) {
+            filename = "operations_log_export.txt";
+        } else if (filename.find('.') == string::npos) {
+            filename += ".txt";
+        }
+
+        if (ifstream(filename).good()) {
+            cout << filename << " already exists. Overwrite? (0 - no, 1 - yes): ";
+            int confirm;
+            cin >> confirm;
+            if (cin.fail() || confirm != 1) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Operation cancelled.\n";
+                return;
+            }
+        }
+
+        long long count = logger.ExportText(filename);
+        if (count < 0) {
+            cout << "Error: Could not export logs to " << filename << ".\n";
+            logger.Log(LogLevel::Error, LogCategory::General, "ERROR: Failed to export logs to " + filename);
+            return;
+        }
+        cout << "Exported " << count << " log entries to " << filename << "\n";
+    }
+
+    void CsvExchange(int& nextPipeId, int& nextCompressId) {
+        cout << "\n===== CSV Import/Export =====\n";
+        cout << "1. Import pipes\n";
+        cout << "2. Import CS\n";
+        cout << "3. Export pipes\n";
+        cout << "4. Export CS\n";
+        cout << "5. Back to Main Menu\n";
+        cout << "Choose an option: ";
+        int choice;
+        cin >> choice;
+        if (cin.fail() || choice < 1 || choice > 5) {
+            cout << "Error: Invalid option.\n";
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            return;
+        }
+        if (choice == 5) return;
+
+        bool pipes = choice == 1 || choice == 3;
+        string defaultName = pipes ? "pipes.csv" : "cs.csv";
+        string filename;
+        cout << "Enter CSV filename (or press Enter for default '" << defaultName << "'): ";
+        cin.ignore();
+        getline(cin, filename);
+        if (filename.empty()) {
+            filename = defaultName;
+        } else if (filename.find('.') == string::npos) {
+            filename += ".csv";
+        }
+
+        bool replaceExisting = false;
+        if (choice <= 2) {
+            cout << "Replace records whose id is already taken? (0 - no, 1 - yes): ";
+            cin >> replaceExisting;
+            if (cin.fail()) {
+                cout << "Error: Invalid input.\n";
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                return;
+            }
+        }
+
+        switch (choice) {
+        case 1: fileManager.ImportPipesCsv(pipeManager, nextPipeId, filename, replaceExisting); break;
+        case 2: fileManager.ImportCompressCsv(compressManager, nextCompressId, filename, replaceExisting); break;
+        case 3: fileManager.ExportPipesCsv(pipeManager, filename); break;
+        case 4: fileManager.ExportCompressCsv(compressManager, filename); break;
+        }
     }
 
     void SearchPipes() {
-        const auto& pipes = pipeManager.GetAll();
-        if (pipes.empty()) {
+        if (pipeManager.Empty()) {
             cout << "\nNo pipes available.\n";
             return;
         }
@@ -281,7 +453,8 @@ public:
             cout << "3. Search by Diameter\n";
             cout << "4. Search by Repair Status\n";
             cout << "5. Search by Length Range\n";
-            cout << "6. Back to Main Menu\n";
+            cout << "6. Combined query\n";
+            cout << "7. Back to Main Menu\n";
             cout << "Choose search criteria: ";
             cin >> choice;
 
@@ -309,6 +482,9 @@ public:
                 SearchPipesByLength();
                 break;
             case 6:
+                SearchPipesByQuery();
+                break;
+            case 7:
                 return;
             default:
                 cout << "Invalid option. Please try again.\n";
@@ -317,8 +493,7 @@ public:
     }
 
     void SearchCompress() {
-        const auto& stations = compressManager.GetAll();
-        if (stations.empty()) {
+        if (compressManager.Empty()) {
             cout << "\nNo CS available.\n";
             return;
         }
@@ -332,7 +507,8 @@ public:
             cout << "4. Search by Working Status\n";
             cout << "5. Search by Working Workshops Count\n";
             cout << "6. Search by Workshop Percentage\n";
-            cout << "7. Back to Main Menu\n";
+            cout << "7. Combined query\n";
+            cout << "8. Back to Main Menu\n";
             cout << "Choose search criteria: ";
             cin >> choice;
 
@@ -363,6 +539,9 @@ public:
                 SearchCompressByPercentage();
                 break;
             case 7:
+                SearchCompressByQuery();
+                break;
+            case 8:
                 return;
             default:
                 cout << "Invalid option. Please try again.\n";
@@ -377,14 +556,14 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to edit pipe - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Failed to edit pipe - invalid ID");
             return;
         }
 
-        Pipe* pipe = pipeManager.FindById(id);
+        const Pipe* pipe = pipeManager.FindById(id);
         if (!pipe) {
             cout << "Error: Pipe not found.\n";
-            logger.Log("ERROR: Pipe not found for editing - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Pipes, "ERROR: Pipe not found for editing - ID: " + to_string(id));
             return;
         }
 
@@ -400,14 +579,14 @@ public:
         if (cin.fail()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            logger.Log("ERROR: Failed to edit CS - invalid ID");
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: Failed to edit CS - invalid ID");
             return;
         }
 
-        Compress* station = compressManager.FindById(id);
+        const Compress* station = compressManager.FindById(id);
         if (!station) {
             cout << "Error: CS not found.\n";
-            logger.Log("ERROR: CS not found for editing - ID: " + to_string(id));
+            logger.Log(LogLevel::Error, LogCategory::Stations, "ERROR: CS not found for editing - ID: " + to_string(id));
             return;
         }
 
@@ -417,7 +596,12 @@ public:
     }
 
 private:
-    void EditPipeFields(Pipe& pipe) {
+    static int SavePercent(const SaveStatus& status) {
+        return status.total == 0 ? 100 : int(status.written * 100 / status.total);
+    }
+
+    void EditPipeFields(const Pipe& current) {
+        Pipe pipe = current;
         cout << "\nEditing pipe: " << pipe.km_mark << "\n";
         cout << "Enter new KM mark: ";
         cin.ignore();
@@ -450,10 +634,12 @@ private:
             return;
         }
 
+        pipeManager.Update(pipe);
         cout << "Pipe updated successfully!\n";
     }
 
-    void EditCompressFields(Compress& station) {
+    void EditCompressFields(const Compress& current) {
+        Compress station = current;
         cout << "\nEditing CS: " << station.name << "\n";
         cout << "Enter new name: ";
         cin.ignore();
@@ -490,17 +676,89 @@ private:
             return;
         }
 
+        compressManager.Update(station);
         cout << "CS updated successfully!\n";
     }
 
-    void DisplayPipesWithEditOption(const vector<Pipe>& pipes) {
-        cout << "\n===== Search Results =====\n";
-        for (size_t i = 0; i < pipes.size(); i++) {
-            cout << "[" << i << "] ID: " << pipes[i].id << " | KM: " << pipes[i].km_mark
-                 << " | Length: " << fixed << setprecision(2) << pipes[i].length << " km"
-                 << " | Diameter: " << pipes[i].diametr << " mm"
-                 << " | On repair: " << (pipes[i].repair ? "Yes" : "No") << "\n";
+    // Local time as "YYYY-MM-DD [HH:MM[:SS]]"; a missing time means the
+    // start of the day, or its end when endOfRange is set.
+    static bool ParseLogTime(const string& text, bool endOfRange, int64_t& nanoseconds) {
+        struct tm t = {};
+        int fields = sscanf(text.c_str(), "%d-%d-%d %d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday,
+                            &t.tm_hour, &t.tm_min, &t.tm_sec);
+        if (fields < 3 || fields == 4) return false;
+        if (fields == 3 && endOfRange) {
+            t.tm_hour = 23;
+            t.tm_min = 59;
+        }
+        if (fields <= 5 && endOfRange) t.tm_sec = 59;
+        t.tm_year -= 1900;
+        t.tm_mon -= 1;
+        t.tm_isdst = -1;
+        time_t seconds = mktime(&t);
+        if (seconds == time_t(-1)) return false;
+        nanoseconds = int64_t(seconds) * 1000000000 + (endOfRange ? 999999999 : 0);
+        return true;
+    }
+
+    // Pages forward from start; earlier page offsets are kept so "p" can
+    // go back without rescanning.
+    void PageLogs(LogViewer& viewer, LogPosition start, const LogFilter& filter) {
+        vector<LogPosition> pageStarts = {start};
+        while (true) {
+            vector<string> lines;
+            LogPosition next = viewer.ReadPage(pageStarts.back(), filter, LOG_PAGE_SIZE, lines);
+
+            cout << "\n===== Operation Logs =====\n";
+            if (pageStarts.size() > 1 || next != viewer.End()) {
+                cout << "Page " << pageStarts.size() << "\n";
+            }
+            for (const auto& line : lines) cout << line << "\n";
+            if (lines.empty()) {
+                cout << (filter.type.empty() && filter.from == INT64_MIN ? "No operations logged yet.\n" : "No matching entries.\n");
+            }
+            if (pageStarts.size() == 1 && next == viewer.End()) return;
+
+            cout << "\nn - next page, p - previous page, any other key - continue: ";
+            string command;
+            cin >> command;
+            if (command == "n" && next != viewer.End()) pageStarts.push_back(next);
+            else if (command == "p" && pageStarts.size() > 1) pageStarts.pop_back();
+            else if (command != "n" && command != "p") return;
         }
+    }
+
+    // Shows one page at a time; returns once the user leaves paging.
+    template<typename T, typename Print>
+    void PageResults(const ResultSet<T>& results, Print print) {
+        size_t pages = results.PageCount(RESULTS_PAGE_SIZE);
+        size_t page = 0;
+        while (true) {
+            cout << "\n===== Search Results =====\n";
+            if (pages > 1) {
+                cout << "Page " << page + 1 << " of " << pages << " (" << results.Size() << " results)\n";
+            }
+            for (size_t i = results.PageBegin(page, RESULTS_PAGE_SIZE); i < results.PageEnd(page, RESULTS_PAGE_SIZE); i++) {
+                if (const T* item = results.Get(i)) print(i, *item);
+            }
+            if (pages <= 1) return;
+
+            cout << "\nn - next page, p - previous page, any other key - continue: ";
+            string command;
+            cin >> command;
+            if (command == "n" && page + 1 < pages) page++;
+            else if (command == "p" && page > 0) page--;
+            else if (command != "n" && command != "p") return;
+        }
+    }
+
+    void DisplayPipesWithEditOption(const ResultSet<Pipe>& pipes) {
+        PageResults(pipes, [](size_t i, const Pipe& pipe) {
+            cout << "[" << i << "] ID: " << pipe.id << " | KM: " << pipe.km_mark
+                 << " | Length: " << fixed << setprecision(2) << pipe.length << " km"
+                 << " | Diameter: " << pipe.diametr << " mm"
+                 << " | On repair: " << (pipe.repair ? "Yes" : "No") << "\n";
+        });
         cout << "\nWould you like to edit any of these results? (0 - no, 1 - yes): ";
         int choice;
         cin >> choice;
@@ -509,15 +767,14 @@ private:
         }
     }
 
-    void DisplayCompressWithEditOption(const vector<Compress>& stations) {
-        cout << "\n===== Search Results =====\n";
-        for (size_t i = 0; i < stations.size(); i++) {
-            cout << "[" << i << "] ID: " << stations[i].id << " | Name: " << stations[i].name
-                 << " | Workshops: " << stations[i].workshop_count
-                 << " | Working: " << stations[i].workshop_working
-                 << " | Class: " << stations[i].classification
-                 << " | Active: " << (stations[i].working ? "Yes" : "No") << "\n";
-        }
+    void DisplayCompressWithEditOption(const ResultSet<Compress>& stations) {
+        PageResults(stations, [](size_t i, const Compress& station) {
+            cout << "[" << i << "] ID: " << station.id << " | Name: " << station.name
+                 << " | Workshops: " << station.workshop_count
+                 << " | Working: " << station.workshop_working
+                 << " | Class: " << station.classification
+                 << " | Active: " << (station.working ? "Yes" : "No") << "\n";
+        });
         cout << "\nWould you like to edit any of these results? (0 - no, 1 - yes): ";
         int choice;
         cin >> choice;
@@ -537,8 +794,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchPipesById(pipeManager.GetAll(), id);
-        if (results.empty()) {
+        auto results = searchEngine.SearchPipesById(pipeManager, id);
+        if (results.Empty()) {
             cout << "No pipes found with ID: " << id << "\n";
             return;
         }
@@ -552,8 +809,8 @@ private:
         cin.ignore();
         getline(cin, kmMark);
 
-        auto results = searchEngine.SearchPipesByKmMark(pipeManager.GetAll(), kmMark);
-        if (results.empty()) {
+        auto results = searchEngine.SearchPipesByKmMark(pipeManager, kmMark);
+        if (results.Empty()) {
             cout << "No pipes found with KM mark containing: " << kmMark << "\n";
             return;
         }
@@ -572,8 +829,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchPipesByDiameter(pipeManager.GetAll(), diameter);
-        if (results.empty()) {
+        auto results = searchEngine.SearchPipesByDiameter(pipeManager, diameter);
+        if (results.Empty()) {
             cout << "No pipes found with diameter: " << diameter << " mm\n";
             return;
         }
@@ -592,8 +849,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchPipesByRepair(pipeManager.GetAll(), repair != 0);
-        if (results.empty()) {
+        auto results = searchEngine.SearchPipesByRepair(pipeManager, repair != 0);
+        if (results.Empty()) {
             cout << "No pipes found with repair status: " << (repair ? "Yes" : "No") << "\n";
             return;
         }
@@ -621,8 +878,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchPipesByLength(pipeManager.GetAll(), minLength, maxLength);
-        if (results.empty()) {
+        auto results = searchEngine.SearchPipesByLength(pipeManager, minLength, maxLength);
+        if (results.Empty()) {
             cout << "No pipes found with length between " << fixed << setprecision(2)
                  << minLength << " and " << maxLength << " km\n";
             return;
@@ -631,6 +888,40 @@ private:
         DisplayPipesWithEditOption(results);
     }
 
+    void SearchPipesByQuery() {
+        string text;
+        cout << "\nFields: id, km, length, diameter, repair\n";
+        cout << "Operators: = != < <= > >= ~ (contains), ranges as 10..20, AND / OR / NOT, ( )\n";
+        cout << "Example: diameter = 1420 AND repair = yes AND length = 10..50\n";
+        cout << "Enter query: ";
+        cin.ignore();
+        getline(cin, text);
+
+        Query query;
+        string error;
+        QueryParser parser;
+        if (!parser.Parse(text, query, error)) {
+            cout << "Error: " << error << "\n";
+            logger.Log(LogLevel::Error, LogCategory::Search, "ERROR: Invalid pipe query - " + error);
+            return;
+        }
+
+        ResultSet<Pipe> results(pipeManager);
+        string report;
+        if (!searchEngine.SearchPipesByQuery(pipeManager, query, results, report)) {
+            cout << "Error: " << report << "\n";
+            return;
+        }
+
+        cout << "\n===== Query Plan =====\n" << report;
+        if (results.Empty()) {
+            cout << "No pipes match the query.\n";
+            return;
+        }
+
+        DisplayPipesWithEditOption(results);
+    }
+
     void SearchCompressById() {
         int id;
         cout << "\nEnter CS ID to search: ";
@@ -642,8 +933,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchCompressById(compressManager.GetAll(), id);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressById(compressManager, id);
+        if (results.Empty()) {
             cout << "No CS found with ID: " << id << "\n";
             return;
         }
@@ -657,8 +948,8 @@ private:
         cin.ignore();
         getline(cin, name);
 
-        auto results = searchEngine.SearchCompressByName(compressManager.GetAll(), name);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressByName(compressManager, name);
+        if (results.Empty()) {
             cout << "No CS found with name containing: " << name << "\n";
             return;
         }
@@ -672,8 +963,8 @@ private:
         cin.ignore();
         getline(cin, classification);
 
-        auto results = searchEngine.SearchCompressByClassification(compressManager.GetAll(), classification);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressByClassification(compressManager, classification);
+        if (results.Empty()) {
             cout << "No CS found with classification containing: " << classification << "\n";
             return;
         }
@@ -692,8 +983,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchCompressByStatus(compressManager.GetAll(), working != 0);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressByStatus(compressManager, working != 0);
+        if (results.Empty()) {
             cout << "No CS found with working status: " << (working ? "Yes" : "No") << "\n";
             return;
         }
@@ -721,8 +1012,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchCompressByWorkshopCount(compressManager.GetAll(), minCount, maxCount);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressByWorkshopCount(compressManager, minCount, maxCount);
+        if (results.Empty()) {
             cout << "No CS found with working workshops between " << minCount << " and " << maxCount << "\n";
             return;
         }
@@ -750,8 +1041,8 @@ private:
             return;
         }
 
-        auto results = searchEngine.SearchCompressByWorkshopPercentage(compressManager.GetAll(), minPercent, maxPercent);
-        if (results.empty()) {
+        auto results = searchEngine.SearchCompressByWorkshopPercentage(compressManager, minPercent, maxPercent);
+        if (results.Empty()) {
             cout << "No CS found with working percentage between " << fixed << setprecision(1)
                  << minPercent << "% and " << maxPercent << "%\n";
             return;
@@ -760,8 +1051,42 @@ private:
         DisplayCompressWithEditOption(results);
     }
 
-    void EditSearchResultsPipes(const vector<Pipe>& searchResults) {
-        if (searchResults.empty()) {
+    void SearchCompressByQuery() {
+        string text;
+        cout << "\nFields: id, name, class, workshops, working, percent, active\n";
+        cout << "Operators: = != < <= > >= ~ (contains), ranges as 10..20, AND / OR / NOT, ( )\n";
+        cout << "Example: active = yes AND percent >= 50 AND class ~ A\n";
+        cout << "Enter query: ";
+        cin.ignore();
+        getline(cin, text);
+
+        Query query;
+        string error;
+        QueryParser parser;
+        if (!parser.Parse(text, query, error)) {
+            cout << "Error: " << error << "\n";
+            logger.Log(LogLevel::Error, LogCategory::Search, "ERROR: Invalid CS query - " + error);
+            return;
+        }
+
+        ResultSet<Compress> results(compressManager);
+        string report;
+        if (!searchEngine.SearchCompressByQuery(compressManager, query, results, report)) {
+            cout << "Error: " << report << "\n";
+            return;
+        }
+
+        cout << "\n===== Query Plan =====\n" << report;
+        if (results.Empty()) {
+            cout << "No CS match the query.\n";
+            return;
+        }
+
+        DisplayCompressWithEditOption(results);
+    }
+
+    void EditSearchResultsPipes(const ResultSet<Pipe>& searchResults) {
+        if (searchResults.Empty()) {
             cout << "No results to edit.\n";
             return;
         }
@@ -797,8 +1122,8 @@ private:
         }
     }
 
-    void EditSearchResultsCompress(const vector<Compress>& searchResults) {
-        if (searchResults.empty()) {
+    void EditSearchResultsCompress(const ResultSet<Compress>& searchResults) {
+        if (searchResults.Empty()) {
             cout << "No results to edit.\n";
             return;
         }
@@ -834,8 +1159,8 @@ private:
         }
     }
 
-    void EditAllPipeResults(const vector<Pipe>& searchResults) {
-        cout << "\nYou are about to edit all " << searchResults.size() << " pipes.\n";
+    void EditAllPipeResults(const ResultSet<Pipe>& searchResults) {
+        cout << "\nYou are about to edit all " << searchResults.Size() << " pipes.\n";
         cout << "Confirm? (0 - no, 1 - yes): ";
         int confirm;
         cin >> confirm;
@@ -846,20 +1171,21 @@ private:
             return;
         }
 
-        for (const auto& result : searchResults) {
-            Pipe* pipe = pipeManager.FindById(result.id);
+        for (size_t i = 0; i < searchResults.Size(); i++) {
+            const Pipe* pipe = pipeManager.Get(searchResults.HandleAt(i));
             if (pipe) {
-                cout << "\n--- Editing Pipe ID: " << pipe->id << " (KM: " << pipe->km_mark << ") ---\n";
-                logger.Log("BATCH EDIT PIPE STARTED - ID: " + to_string(pipe->id));
+                int id = pipe->id;
+                cout << "\n--- Editing Pipe ID: " << id << " (KM: " << pipe->km_mark << ") ---\n";
+                logger.Log("BATCH EDIT PIPE STARTED - ID: " + to_string(id));
                 EditPipeFields(*pipe);
-                logger.Log("BATCH EDIT PIPE COMPLETED - ID: " + to_string(pipe->id));
+                logger.Log("BATCH EDIT PIPE COMPLETED - ID: " + to_string(id));
             }
         }
         cout << "\nBatch edit completed!\n";
     }
 
-    void EditAllCompressResults(const vector<Compress>& searchResults) {
-        cout << "\nYou are about to edit all " << searchResults.size() << " CS.\n";
+    void EditAllCompressResults(const ResultSet<Compress>& searchResults) {
+        cout << "\nYou are about to edit all " << searchResults.Size() << " CS.\n";
         cout << "Confirm? (0 - no, 1 - yes): ";
         int confirm;
         cin >> confirm;
@@ -870,60 +1196,63 @@ private:
             return;
         }
 
-        for (const auto& result : searchResults) {
-            Compress* station = compressManager.FindById(result.id);
+        for (size_t i = 0; i < searchResults.Size(); i++) {
+            const Compress* station = compressManager.Get(searchResults.HandleAt(i));
             if (station) {
-                cout << "\n--- Editing CS ID: " << station->id << " (Name: " << station->name << ") ---\n";
-                logger.Log("BATCH EDIT CS STARTED - ID: " + to_string(station->id));
+                int id = station->id;
+                cout << "\n--- Editing CS ID: " << id << " (Name: " << station->name << ") ---\n";
+                logger.Log("BATCH EDIT CS STARTED - ID: " + to_string(id));
                 EditCompressFields(*station);
-                logger.Log("BATCH EDIT CS COMPLETED - ID: " + to_string(station->id));
+                logger.Log("BATCH EDIT CS COMPLETED - ID: " + to_string(id));
             }
         }
         cout << "\nBatch edit completed!\n";
     }
 
-    void EditSpecificPipeResult(const vector<Pipe>& searchResults) {
+    void EditSpecificPipeResult(const ResultSet<Pipe>& searchResults) {
         int index;
-        cout << "\nEnter index of pipe to edit (0-" << (searchResults.size() - 1) << "): ";
+        cout << "\nEnter index of pipe to edit (0-" << (searchResults.Size() - 1) << "): ";
         cin >> index;
-        if (cin.fail() || index < 0 || index >= (int)searchResults.size()) {
+        if (cin.fail() || index < 0 || index >= (int)searchResults.Size()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
             cout << "Error: Invalid index.\n";
             return;
         }
 
-        Pipe* pipe = pipeManager.FindById(searchResults[index].id);
+        const Pipe* pipe = pipeManager.Get(searchResults.HandleAt(index));
         if (!pipe) {
             cout << "Error: Pipe not found.\n";
             return;
         }
 
-        logger.Log("EDIT PIPE FROM SEARCH - ID: " + to_string(pipe->id) + ", Old Name: " + pipe->km_mark);
+        int id = pipe->id;
+        logger.Log("EDIT PIPE FROM SEARCH - ID: " + to_string(id) + ", Old Name: " + pipe->km_mark);
         EditPipeFields(*pipe);
-        logger.Log("EDIT PIPE FROM SEARCH COMPLETED - ID: " + to_string(pipe->id));
+        logger.Log("EDIT PIPE FROM SEARCH COMPLETED - ID: " + to_string(id));
     }
 
-    void EditSpecificCompressResult(const vector<Compress>& searchResults) {
+    void EditSpecificCompressResult(const ResultSet<Compress>& searchResults) {
         int index;
-        cout << "\nEnter index of CS to edit (0-" << (searchResults.size() - 1) << "): ";
+        cout << "\nEnter index of CS to edit (0-" << (searchResults.Size() - 1) << "): ";
         cin >> index;
-        if (cin.fail() || index < 0 || index >= (int)searchResults.size()) {
+        if (cin.fail() || index < 0 || index >= (int)searchResults.Size()) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
             cout << "Error: Invalid index.\n";
             return;
         }
 
-        Compress* station = compressManager.FindById(searchResults[index].id);
+        const Compress* station = compressManager.Get(searchResults.HandleAt(index));
         if (!station) {
             cout << "Error: CS not found.\n";
             return;
         }
 
-        logger.Log("EDIT CS FROM SEARCH - ID: " + to_string(station->id) + ", Old Name: " + station->name);
+        int id = station->id;
+        logger.Log("EDIT CS FROM SEARCH - ID: " + to_string(id) + ", Old Name: " + station->name);
         EditCompressFields(*station);
-        logger.Log("EDIT CS FROM SEARCH COMPLETED - ID: " + to_string(station->id));
+        logger.Log("EDIT CS FROM SEARCH COMPLETED - ID: " + to_string(id));
     }
 };
 